@@ -0,0 +1,345 @@
+#include "port_farm.h"
+#include "cert_utils.h"
+#include "timer_wheel.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+
+/**
+ * @brief Creates a TCP socket bound to an ephemeral port on 127.0.0.1.
+ * @param port Output port number.
+ * @return The socket, or -1 on failure (an error is printed).
+ */
+static int bind_loopback(int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Error: socket() failed - " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        std::cerr << "Error: bind() failed - " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+/**
+ * @brief Connects to 127.0.0.1:port and waits up to one second for the handshake.
+ * @return The connected socket, or -1.
+ */
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (poll(&pfd, 1, 1000) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+PortFarm::PortFarm() : epoll_fd_(-1), wake_fd_(-1) {}
+
+PortFarm::~PortFarm() {
+    stop();
+}
+
+bool PortFarm::start(std::size_t open, std::size_t closed, std::size_t filtered) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        std::cerr << "Error: epoll/eventfd setup failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+    int port = 0;
+    for (std::size_t i = 0; i < open; ++i) {
+        int fd = bind_loopback(port);
+        if (fd < 0 || listen(fd, SOMAXCONN) < 0) {
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        fds_.push_back(fd);
+        listen_fds_.push_back(fd);
+        open_ports_.push_back(port);
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+    for (std::size_t i = 0; i < closed; ++i) {
+        int fd = bind_loopback(port);
+        if (fd < 0) {
+            return false;
+        }
+        fds_.push_back(fd);
+        closed_ports_.push_back(port);
+    }
+    for (std::size_t i = 0; i < filtered; ++i) {
+        // listen(0) admits one queued connection; take that slot ourselves.
+        int fd = bind_loopback(port);
+        if (fd < 0 || listen(fd, 0) < 0) {
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        fds_.push_back(fd);
+        int filler = connect_loopback(port);
+        if (filler < 0) {
+            std::cerr << "Error: could not fill accept queue for filtered port " << port << "\n";
+            return false;
+        }
+        fds_.push_back(filler);
+        filtered_ports_.push_back(port);
+    }
+
+    acceptor_ = std::thread(&PortFarm::accept_main, this);
+    return true;
+}
+
+void PortFarm::stop() {
+    if (acceptor_.joinable()) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "Error: eventfd write failed - " << std::strerror(errno) << "\n";
+        }
+        acceptor_.join();
+    }
+    for (int fd : fds_) close(fd);
+    fds_.clear();
+    listen_fds_.clear();
+    open_ports_.clear();
+    closed_ports_.clear();
+    filtered_ports_.clear();
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    epoll_fd_ = wake_fd_ = -1;
+}
+
+/**
+ * @brief Accepts and immediately closes connections on the open ports.
+ */
+void PortFarm::accept_main() {
+    struct epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(epoll_fd_, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                return;
+            }
+            int conn;
+            while ((conn = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+                close(conn);
+            }
+        }
+    }
+}
+
+TlsServer::TlsServer()
+    : ctx_(nullptr), listen_fd_(-1), wake_fd_(-1), port_(0), latency_ms_(0), handshakes_(0) {}
+
+TlsServer::~TlsServer() {
+    stop();
+}
+
+/**
+ * @brief Builds a one-day self-signed EC P-256 certificate for CN=localhost.
+ * @return true if cert and key were installed in ctx.
+ */
+static bool install_self_signed(SSL_CTX* ctx) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    bool ok = key && cert;
+    if (ok) {
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_NAME* name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        ok = X509_set_issuer_name(cert, name) == 1 &&
+             X509_set_pubkey(cert, key) == 1 &&
+             X509_sign(cert, key, EVP_sha256()) > 0 &&
+             SSL_CTX_use_certificate(ctx, cert) == 1 &&
+             SSL_CTX_use_PrivateKey(ctx, key) == 1;
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+bool TlsServer::start(uint32_t latency_ms) {
+    latency_ms_ = latency_ms;
+    ctx_ = SSL_CTX_new(TLS_server_method());
+    if (!ctx_ || !install_self_signed(ctx_)) {
+        log_ssl_errors("Failed to create benchmark TLS server certificate");
+        return false;
+    }
+    listen_fd_ = bind_loopback(port_);
+    if (listen_fd_ < 0 || listen(listen_fd_, SOMAXCONN) < 0) {
+        std::cerr << "Error: TLS server listen() failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        std::cerr << "Error: eventfd() failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    server_ = std::thread(&TlsServer::serve_main, this);
+    return true;
+}
+
+void TlsServer::stop() {
+    if (server_.joinable()) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "Error: eventfd write failed - " << std::strerror(errno) << "\n";
+        }
+        server_.join();
+    }
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    listen_fd_ = wake_fd_ = -1;
+    if (ctx_) SSL_CTX_free(ctx_);
+    ctx_ = nullptr;
+}
+
+/**
+ * @brief Accepts connections, delays each by latency_ms, then drives its handshake.
+ */
+void TlsServer::serve_main() {
+    struct Delayed {
+        int fd;
+        uint64_t ready_ms;
+    };
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        std::cerr << "Error: epoll_create1() failed - " << std::strerror(errno) << "\n";
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.data.fd = wake_fd_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+    std::unordered_map<int, SSL*> conns;
+    std::deque<Delayed> delayed;  // constant latency keeps this in ready order
+
+    auto finish = [&](int fd) {
+        SSL* ssl = conns[fd];
+        conns.erase(fd);
+        epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+        SSL_free(ssl);
+        close(fd);
+    };
+    auto drive = [&](int fd) {
+        SSL* ssl = conns[fd];
+        int rc = SSL_do_handshake(ssl);
+        if (rc == 1) {
+            ++handshakes_;
+            SSL_shutdown(ssl);
+            finish(fd);
+            return;
+        }
+        int err = SSL_get_error(ssl, rc);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+            ERR_clear_error();
+            finish(fd);
+            return;
+        }
+        struct epoll_event cev;
+        cev.events = err == SSL_ERROR_WANT_READ ? EPOLLIN : EPOLLOUT;
+        cev.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, fd, &cev);
+    };
+    auto begin = [&](int fd) {
+        SSL* ssl = SSL_new(ctx_);
+        SSL_set_fd(ssl, fd);
+        SSL_set_accept_state(ssl);
+        conns[fd] = ssl;
+        struct epoll_event cev;
+        cev.events = EPOLLIN;
+        cev.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev);
+        drive(fd);
+    };
+
+    struct epoll_event events[256];
+    bool running = true;
+    while (running) {
+        uint64_t now = monotonic_ms();
+        while (!delayed.empty() && delayed.front().ready_ms <= now) {
+            begin(delayed.front().fd);
+            delayed.pop_front();
+        }
+        int timeout = delayed.empty() ? -1 : static_cast<int>(delayed.front().ready_ms - now);
+        int n = epoll_wait(ep, events, 256, timeout);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                running = false;
+            } else if (fd == listen_fd_) {
+                int conn;
+                while ((conn = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    if (latency_ms_ == 0) {
+                        begin(conn);
+                    } else {
+                        delayed.push_back(Delayed{conn, monotonic_ms() + latency_ms_});
+                    }
+                }
+            } else if (conns.count(fd)) {
+                drive(fd);
+            }
+        }
+    }
+
+    for (const auto& d : delayed) close(d.fd);
+    while (!conns.empty()) finish(conns.begin()->first);
+    close(ep);
+}
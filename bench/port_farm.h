@@ -0,0 +1,92 @@
+#pragma once
+#include <openssl/ssl.h>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Synthetic open, closed and filtered ports on 127.0.0.1.
+ *
+ * - Open ports are listening sockets; the kernel completes the handshake,
+ *   and accepted connections are drained by a background thread.
+ * - Closed ports are bound but not listening, so a SYN is answered with RST
+ *   and no other process can take the port while the farm runs.
+ * - Filtered ports are listeners with a one-slot accept queue that the farm
+ *   fills itself and never accepts from; further SYNs are dropped by the
+ *   kernel, so probes time out exactly as behind a dropping firewall.
+ */
+class PortFarm {
+public:
+    PortFarm();
+    ~PortFarm();
+
+    PortFarm(const PortFarm&) = delete;
+    PortFarm& operator=(const PortFarm&) = delete;
+
+    /**
+     * @brief Binds the requested number of ports of each kind.
+     * @return false if a socket could not be created (an error is printed).
+     */
+    bool start(std::size_t open, std::size_t closed, std::size_t filtered);
+
+    /** @brief Closes every socket and stops the accept thread. */
+    void stop();
+
+    const std::vector<int>& open_ports() const { return open_ports_; }
+    const std::vector<int>& closed_ports() const { return closed_ports_; }
+    const std::vector<int>& filtered_ports() const { return filtered_ports_; }
+
+private:
+    void accept_main();
+
+    std::vector<int> fds_;
+    std::vector<int> listen_fds_;
+    std::vector<int> open_ports_, closed_ports_, filtered_ports_;
+    int epoll_fd_;
+    int wake_fd_;
+    std::thread acceptor_;
+};
+
+/**
+ * @brief Minimal TLS server on 127.0.0.1 with a freshly generated self-signed certificate.
+ *
+ * Handshakes run non-blocking on one epoll thread. Each accepted connection
+ * is held for latency_ms before the handshake starts, which emulates a slow
+ * or distant server for certificate retrieval.
+ */
+class TlsServer {
+public:
+    TlsServer();
+    ~TlsServer();
+
+    TlsServer(const TlsServer&) = delete;
+    TlsServer& operator=(const TlsServer&) = delete;
+
+    /**
+     * @brief Generates a certificate, binds an ephemeral port and starts serving.
+     * @param latency_ms Delay before each handshake starts.
+     * @return false on failure (an error is printed).
+     */
+    bool start(uint32_t latency_ms);
+
+    /** @brief Stops the server thread and frees the certificate. */
+    void stop();
+
+    /** @brief Port the server listens on. */
+    int port() const { return port_; }
+
+    /** @brief Handshakes completed so far. */
+    uint64_t handshakes() const { return handshakes_.load(); }
+
+private:
+    void serve_main();
+
+    SSL_CTX* ctx_;
+    int listen_fd_;
+    int wake_fd_;
+    int port_;
+    uint32_t latency_ms_;
+    std::atomic<uint64_t> handshakes_;
+    std::thread server_;
+};
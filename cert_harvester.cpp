@@ -0,0 +1,317 @@
+#include "cert_harvester.h"
+#include "scan_engine.h"
+#include "metrics.h"
+#include <openssl/err.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+TlsContext& TlsContext::instance() {
+    static TlsContext context;
+    return context;
+}
+
+TlsContext::TlsContext() : ctx_(nullptr) {
+    OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, nullptr);
+    ERR_clear_error();
+
+    // OpenSSL writes with write(), so a peer that closes first (e.g. before our
+    // close_notify) would kill the process with SIGPIPE. Ignore it unless the
+    // application installed its own handler.
+    struct sigaction sa;
+    if (sigaction(SIGPIPE, nullptr, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    ctx_ = SSL_CTX_new(TLS_client_method());
+    if (!ctx_) {
+        log_ssl_errors("SSL_CTX_new");
+        return;
+    }
+    // Always a full handshake (see the class comment); without tickets the
+    // server also skips sending ones we would never use.
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_TICKET);
+}
+
+TlsContext::~TlsContext() {
+    if (ctx_) SSL_CTX_free(ctx_);
+}
+
+SSL* TlsContext::new_ssl() {
+    if (!ctx_) {
+        return nullptr;
+    }
+    SSL* ssl = SSL_new(ctx_);
+    if (!ssl) {
+        log_ssl_errors("SSL_new");
+        return nullptr;
+    }
+    return ssl;
+}
+
+/**
+ * @brief Packs a connection slot and its generation into epoll user data.
+ */
+static uint64_t pack_token(uint32_t slot, uint32_t gen) {
+    return (static_cast<uint64_t>(gen) << 32) | slot;
+}
+
+CertHarvester::CertHarvester(const CertHarvesterOptions& options)
+    : options_(options),
+      epfd_(epoll_create1(EPOLL_CLOEXEC)),
+      in_flight_(0),
+      wheel_(options.tick_ms, 4096) {
+    if (epfd_ < 0) {
+        std::cerr << "Error: epoll_create1() failed - " << std::strerror(errno) << "\n";
+    }
+    std::size_t window = clamp_to_fd_limit(options_.max_in_flight ? options_.max_in_flight : 1);
+    conns_.resize(window);
+    for (std::size_t i = window; i > 0; --i) {
+        free_slots_.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+CertHarvester::~CertHarvester() {
+    for (auto& c : conns_) {
+        if (c.ssl) SSL_free(c.ssl);
+        if (c.fd >= 0) close(c.fd);
+    }
+    if (epfd_ >= 0) close(epfd_);
+}
+
+std::size_t CertHarvester::add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                                      const RttEstimator& rtt) {
+    targets_.push_back(Target{host, addr, addr_len, rtt});
+    return targets_.size() - 1;
+}
+
+void CertHarvester::submit(std::size_t target, int port) {
+    queue_.push_back(Pending{target, port});
+}
+
+/**
+ * @brief Starts a non-blocking connect for one handshake.
+ * @return false if the socket could not be created because descriptors ran out
+ *         and the attempt should be requeued; true otherwise.
+ */
+bool CertHarvester::launch(const Pending& p, const ResultCallback& on_result) {
+    const Target& t = targets_[p.target];
+    CertInfo failed;
+
+    uint64_t socket_start = monotonic_us();
+    int sock = socket(t.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    uint64_t connect_start = monotonic_us();
+    metrics_record(MetricPhase::SOCKET_CREATE, connect_start - socket_start);
+    if (sock < 0) {
+        metrics_count_errno(errno);
+        if ((errno == EMFILE || errno == ENFILE) && in_flight_ > 0) {
+            return false;
+        }
+        std::cerr << "Error: socket() failed for " << t.host << ":" << p.port
+                  << " - " << std::strerror(errno) << "\n";
+        on_result(CertResult{p.target, p.port, failed});
+        return true;
+    }
+
+    sockaddr_storage addr = t.addr;
+    if (addr.ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port = htons(static_cast<uint16_t>(p.port));
+    } else {
+        reinterpret_cast<sockaddr_in*>(&addr)->sin_port = htons(static_cast<uint16_t>(p.port));
+    }
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), t.addr_len) < 0 && errno != EINPROGRESS) {
+        // Connection refused / host unreachable is a normal scan result.
+        metrics_count_errno(errno);
+        close(sock);
+        on_result(CertResult{p.target, p.port, failed});
+        return true;
+    }
+
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    Conn& c = conns_[slot];
+    c.fd = sock;
+    c.ssl = nullptr;
+    c.phase = Phase::CONNECTING;
+    c.target = p.target;
+    c.port = p.port;
+    c.start_ms = monotonic_ms();
+    c.phase_start_us = connect_start;
+    ++c.gen;
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT;
+    ev.data.u64 = pack_token(slot, c.gen);
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, sock, &ev) < 0) {
+        std::cerr << "Error: epoll_ctl() failed for " << t.host << ":" << p.port
+                  << " - " << std::strerror(errno) << "\n";
+        ++in_flight_;
+        finish(slot, failed, on_result);
+        return true;
+    }
+    uint32_t deadline = options_.adaptive_timeout
+        ? t.rtt.timeout_ms(options_.timeout_ms, options_.min_timeout_ms, options_.timeout_ms)
+        : options_.timeout_ms;
+    wheel_.schedule(c.start_ms, deadline, slot, c.gen);
+    ++in_flight_;
+    return true;
+}
+
+/**
+ * @brief Handles readiness on a connection in either phase.
+ */
+void CertHarvester::on_event(uint32_t slot, const ResultCallback& on_result) {
+    Conn& c = conns_[slot];
+    CertInfo failed;
+    if (c.phase == Phase::CONNECTING) {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        uint64_t now_us = monotonic_us();
+        metrics_record(MetricPhase::CONNECT, now_us - c.phase_start_us);
+        if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0 || so_error != 0) {
+            metrics_count_errno(so_error ? so_error : errno);
+            finish(slot, failed, on_result);
+            return;
+        }
+        // Connected: record the round trip and give the handshake whatever
+        // remains of the overall deadline.
+        uint64_t now = monotonic_ms();
+        uint32_t elapsed = static_cast<uint32_t>(now - c.start_ms);
+        targets_[c.target].rtt.sample(elapsed);
+        ++c.gen;
+        uint32_t remaining = elapsed < options_.timeout_ms ? options_.timeout_ms - elapsed : 0;
+        wheel_.schedule(now, remaining, slot, c.gen);
+
+        const std::string& host = targets_[c.target].host;
+        c.ssl = TlsContext::instance().new_ssl();
+        if (!c.ssl) {
+            finish(slot, failed, on_result);
+            return;
+        }
+        SSL_set_fd(c.ssl, c.fd);
+        SSL_set_tlsext_host_name(c.ssl, host.c_str());
+        SSL_set_connect_state(c.ssl);
+        c.phase = Phase::HANDSHAKING;
+        c.phase_start_us = now_us;
+    }
+    drive_handshake(slot, on_result);
+}
+
+/**
+ * @brief Advances the TLS handshake and re-arms epoll for whatever it needs next.
+ */
+void CertHarvester::drive_handshake(uint32_t slot, const ResultCallback& on_result) {
+    Conn& c = conns_[slot];
+    CertInfo failed;
+
+    ERR_clear_error();
+    int rc = SSL_do_handshake(c.ssl);
+    if (rc == 1) {
+        metrics_record(MetricPhase::TLS_HANDSHAKE, monotonic_us() - c.phase_start_us);
+        X509* cert = SSL_get_peer_certificate(c.ssl);
+        if (!cert) {
+            std::cerr << "Error: no certificate presented by " << targets_[c.target].host
+                      << ":" << c.port << "\n";
+            log_ssl_errors("SSL_get_peer_certificate");
+            finish(slot, failed, on_result);
+            return;
+        }
+        CertInfo info = cert_info_from_x509(cert);
+        X509_free(cert);
+
+        // Send close_notify so the server sees an orderly close.
+        SSL_shutdown(c.ssl);
+        ERR_clear_error();
+        finish(slot, info, on_result);
+        return;
+    }
+
+    int err = SSL_get_error(c.ssl, rc);
+    uint32_t events;
+    if (err == SSL_ERROR_WANT_READ) {
+        events = EPOLLIN;
+    } else if (err == SSL_ERROR_WANT_WRITE) {
+        events = EPOLLOUT;
+    } else {
+        log_ssl_errors("SSL_do_handshake");
+        finish(slot, failed, on_result);
+        return;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = pack_token(slot, c.gen);
+    if (epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev) < 0) {
+        std::cerr << "Error: epoll_ctl() failed - " << std::strerror(errno) << "\n";
+        finish(slot, failed, on_result);
+    }
+}
+
+/**
+ * @brief Releases a connection slot and emits its result.
+ */
+void CertHarvester::finish(uint32_t slot, const CertInfo& info, const ResultCallback& on_result) {
+    Conn& c = conns_[slot];
+    CertResult result{c.target, c.port, info};
+    if (c.ssl) {
+        SSL_free(c.ssl);
+        c.ssl = nullptr;
+    }
+    close(c.fd);
+    c.fd = -1;
+    ++c.gen; // invalidates the pending timer entry
+    free_slots_.push_back(slot);
+    --in_flight_;
+    on_result(result);
+}
+
+bool CertHarvester::run(const ResultCallback& on_result) {
+    if (epfd_ < 0 || !TlsContext::instance().ctx()) {
+        return false;
+    }
+
+    const int kMaxEvents = 256;
+    struct epoll_event events[kMaxEvents];
+
+    while (!queue_.empty() || in_flight_ > 0) {
+        while (!queue_.empty() && !free_slots_.empty()) {
+            Pending p = queue_.front();
+            queue_.pop_front();
+            if (!launch(p, on_result)) {
+                queue_.push_front(p);
+                break;
+            }
+        }
+        if (in_flight_ == 0) {
+            continue;
+        }
+
+        int n = epoll_wait(epfd_, events, kMaxEvents, wheel_.next_timeout_ms(monotonic_ms()));
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "Error: epoll_wait() failed - " << std::strerror(errno) << "\n";
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t slot = static_cast<uint32_t>(events[i].data.u64 & 0xffffffffu);
+            uint32_t gen = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            if (conns_[slot].fd >= 0 && conns_[slot].gen == gen) {
+                on_event(slot, on_result);
+            }
+        }
+
+        wheel_.advance(monotonic_ms(), [&](uint32_t slot, uint32_t gen) {
+            if (conns_[slot].fd >= 0 && conns_[slot].gen == gen) {
+                CertInfo failed;
+                finish(slot, failed, on_result); // Timeout
+            }
+        });
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "cert_utils.h"
+#include "timer_wheel.h"
+#include "rate_control.h"
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Process-wide OpenSSL client context.
+ *
+ * OpenSSL is initialised exactly once and a single SSL_CTX is shared by every
+ * handshake. Sessions are never resumed: a resumed handshake carries no
+ * Certificate message, so the peer certificate would be the one cached from
+ * the original session even after the server rotated it, and every handshake
+ * here exists to read that certificate.
+ */
+class TlsContext {
+public:
+    /** @brief Returns the shared context, creating it on first use. */
+    static TlsContext& instance();
+
+    /** @brief The shared SSL_CTX, or nullptr if creation failed. */
+    SSL_CTX* ctx() const { return ctx_; }
+
+    /**
+     * @brief Creates an SSL object for one full handshake.
+     * @return New SSL object (caller frees), or nullptr on failure.
+     */
+    SSL* new_ssl();
+
+private:
+    TlsContext();
+    ~TlsContext();
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    SSL_CTX* ctx_;
+};
+
+/**
+ * @brief Tunables for the certificate harvester.
+ */
+struct CertHarvesterOptions {
+    std::size_t max_in_flight = 256; ///< Concurrent connects/handshakes.
+    uint32_t timeout_ms = 3000;      ///< Deadline covering connect and handshake together.
+    uint32_t tick_ms = 10;           ///< Timer wheel resolution.
+    bool adaptive_timeout = true;    ///< Cut the connect phase short using the target's measured RTT.
+    uint32_t min_timeout_ms = 100;   ///< Floor for the adaptive connect deadline.
+};
+
+/**
+ * @brief A harvested certificate, delivered as soon as its handshake finishes or fails.
+ */
+struct CertResult {
+    std::size_t target;  ///< Index returned by CertHarvester::add_target().
+    int port;            ///< Port the handshake was attempted on.
+    CertInfo info;       ///< Certificate details; info.valid() is false on any failure.
+};
+
+/**
+ * @brief Concurrent TLS certificate harvester.
+ *
+ * Drives many non-blocking connects and TLS handshakes on one epoll instance.
+ * Every attempt has a real deadline enforced through a timer wheel, so a
+ * black-holed host costs at most timeout_ms of one concurrency slot. Once a
+ * target has answered a connect, later connects to it are given an RTT-based
+ * deadline; the handshake keeps whatever remains of timeout_ms.
+ */
+class CertHarvester {
+public:
+    using ResultCallback = std::function<void(const CertResult&)>;
+
+    explicit CertHarvester(const CertHarvesterOptions& options = CertHarvesterOptions());
+    ~CertHarvester();
+
+    CertHarvester(const CertHarvester&) = delete;
+    CertHarvester& operator=(const CertHarvester&) = delete;
+
+    /**
+     * @brief Registers a resolved target.
+     * @param host Hostname, used for SNI and reporting.
+     * @param addr Resolved socket address; the port field is overwritten per attempt.
+     * @param addr_len Length of addr.
+     * @param rtt Estimate carried over from earlier runs (see TargetCache::rtt()).
+     * @return Target index to pass to submit().
+     */
+    std::size_t add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                           const RttEstimator& rtt = RttEstimator());
+
+    /** @brief Hostname registered for a target index. */
+    const std::string& target_host(std::size_t target) const { return targets_[target].host; }
+
+    /** @brief RTT estimate for a target, including samples from this run. */
+    const RttEstimator& target_rtt(std::size_t target) const { return targets_[target].rtt; }
+
+    /**
+     * @brief Queues a handshake; nothing is sent until run() is called.
+     * @param target Index returned by add_target().
+     * @param port TLS port.
+     */
+    void submit(std::size_t target, int port);
+
+    /**
+     * @brief Drives all queued handshakes to completion.
+     * @param on_result Invoked once per submitted handshake.
+     * @return false if the event loop or TLS context could not be created.
+     */
+    bool run(const ResultCallback& on_result);
+
+private:
+    struct Target {
+        std::string host;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        RttEstimator rtt;
+    };
+
+    enum class Phase { CONNECTING, HANDSHAKING };
+
+    struct Conn {
+        int fd = -1;
+        uint32_t gen = 0;
+        SSL* ssl = nullptr;
+        Phase phase = Phase::CONNECTING;
+        std::size_t target = 0;
+        int port = 0;
+        uint64_t start_ms = 0;
+        uint64_t phase_start_us = 0;  ///< Start of the current phase, for metrics.
+    };
+
+    struct Pending {
+        std::size_t target;
+        int port;
+    };
+
+    bool launch(const Pending& p, const ResultCallback& on_result);
+    void on_event(uint32_t slot, const ResultCallback& on_result);
+    void drive_handshake(uint32_t slot, const ResultCallback& on_result);
+    void finish(uint32_t slot, const CertInfo& info, const ResultCallback& on_result);
+
+    CertHarvesterOptions options_;
+    int epfd_;
+    std::vector<Target> targets_;
+    std::deque<Pending> queue_;
+    std::vector<Conn> conns_;
+    std::vector<uint32_t> free_slots_;
+    std::size_t in_flight_;
+    TimerWheel wheel_;
+};
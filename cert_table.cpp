@@ -0,0 +1,153 @@
+#include "cert_table.h"
+#include <openssl/asn1.h>
+#include <openssl/evp.h>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <time.h>
+
+namespace {
+
+/**
+ * @brief Parses an expiry in ASN1_TIME_print() form back into a UTC timestamp.
+ * @return 0 if the string is not in that form.
+ */
+time_t parse_not_after(const std::string& not_after) {
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    if (!strptime(not_after.c_str(), "%b %d %H:%M:%S %Y", &tm)) {
+        return 0;
+    }
+    return timegm(&tm);
+}
+
+/**
+ * @brief Returns a NAME as a one-line "/CN=..." string.
+ */
+std::string name_oneline(X509_NAME* name) {
+    char* text = X509_NAME_oneline(name, nullptr, 0);
+    std::string out = text ? text : "";
+    if (text) OPENSSL_free(text);
+    return out;
+}
+
+} // namespace
+
+CertRecord::CertRecord(X509* cert, const CertFingerprint& fingerprint)
+    : x509_(cert), fingerprint_(fingerprint), has_fingerprint_(true), self_signed_(false), not_after_time_(0) {
+    X509_up_ref(x509_);
+}
+
+CertRecord::CertRecord(const std::string& subject, const std::string& issuer, const std::string& not_after,
+                       bool self_signed, const CertFingerprint& fingerprint)
+    : x509_(nullptr), fingerprint_(fingerprint), has_fingerprint_(fingerprint != CertFingerprint()),
+      subject_(subject), issuer_(issuer), not_after_(not_after), self_signed_(self_signed), not_after_time_(0) {
+    // Nothing to parse lazily except the timestamp.
+    std::call_once(names_once_, []() {});
+}
+
+CertRecord::~CertRecord() {
+    if (x509_) X509_free(x509_);
+}
+
+void CertRecord::parse_names() const {
+    X509_NAME* subject = X509_get_subject_name(x509_);
+    X509_NAME* issuer = X509_get_issuer_name(x509_);
+    subject_ = name_oneline(subject);
+    issuer_ = name_oneline(issuer);
+    // Check if certificate is self-signed (subject == issuer)
+    self_signed_ = X509_NAME_cmp(subject, issuer) == 0;
+}
+
+void CertRecord::parse_expiry() const {
+    if (!x509_) {
+        not_after_time_ = parse_not_after(not_after_);
+        return;
+    }
+    // Same text as ASN1_TIME_print(), without a temporary memory BIO.
+    static const char* const kMonths[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    if (ASN1_TIME_to_tm(X509_get0_notAfter(x509_), &tm) != 1 || tm.tm_mon < 0 || tm.tm_mon > 11) {
+        return;
+    }
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s %2d %02d:%02d:%02d %d GMT", kMonths[tm.tm_mon], tm.tm_mday,
+                  tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_year + 1900);
+    not_after_ = buf;
+    not_after_time_ = timegm(&tm);
+}
+
+const std::string& CertRecord::subject() const {
+    std::call_once(names_once_, &CertRecord::parse_names, this);
+    return subject_;
+}
+
+const std::string& CertRecord::issuer() const {
+    std::call_once(names_once_, &CertRecord::parse_names, this);
+    return issuer_;
+}
+
+bool CertRecord::self_signed() const {
+    std::call_once(names_once_, &CertRecord::parse_names, this);
+    return self_signed_;
+}
+
+const std::string& CertRecord::not_after() const {
+    std::call_once(expiry_once_, &CertRecord::parse_expiry, this);
+    return not_after_;
+}
+
+time_t CertRecord::not_after_time() const {
+    std::call_once(expiry_once_, &CertRecord::parse_expiry, this);
+    return not_after_time_;
+}
+
+std::size_t CertTable::FingerprintHash::operator()(const CertFingerprint& fp) const {
+    // The fingerprint is already a uniform hash; any 8 bytes of it will do.
+    uint64_t h;
+    std::memcpy(&h, fp.data(), sizeof(h));
+    return static_cast<std::size_t>(h);
+}
+
+CertTable& CertTable::instance() {
+    static CertTable* table = new CertTable(); // Leaked: records may outlive static destruction.
+    return *table;
+}
+
+std::shared_ptr<const CertRecord> CertTable::intern(X509* cert) {
+    CertFingerprint fp;
+    unsigned int len = 0;
+    if (X509_digest(cert, EVP_sha256(), fp.data(), &len) != 1 || len != fp.size()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<const CertRecord>& slot = records_[fp];
+    std::shared_ptr<const CertRecord> record = slot.lock();
+    if (record) {
+        return record;
+    }
+    record = std::make_shared<const CertRecord>(cert, fp);
+    slot = record;
+
+    // Drop entries whose certificates are no longer referenced once the
+    // table has doubled since the last sweep.
+    if (records_.size() >= purge_at_) {
+        for (auto it = records_.begin(); it != records_.end();) {
+            it = it->second.expired() ? records_.erase(it) : std::next(it);
+        }
+        purge_at_ = records_.size() * 2 > 1024 ? records_.size() * 2 : 1024;
+    }
+    return record;
+}
+
+std::size_t CertTable::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t live = 0;
+    for (const auto& kv : records_) {
+        live += kv.second.expired() ? 0 : 1;
+    }
+    return live;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <openssl/x509.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// SHA-256 of a certificate's DER encoding.
+using CertFingerprint = std::array<uint8_t, 32>;
+
+/**
+ * @brief One distinct certificate, shared by every result that presented it.
+ *
+ * Records made from an X509 keep a reference to it and parse the subject,
+ * issuer and expiry only on first access, each at most once even when read
+ * from several threads. Records rebuilt from stored strings (see
+ * MappedResultStore) carry those strings directly, with the fingerprint if
+ * the store had one.
+ */
+class CertRecord {
+public:
+    /**
+     * @param cert Peer certificate; a reference is taken.
+     * @param fingerprint SHA-256 of its DER encoding.
+     */
+    CertRecord(X509* cert, const CertFingerprint& fingerprint);
+
+    /**
+     * @brief Record with already-known fields.
+     * @param fingerprint SHA-256 DER fingerprint; all zero if unknown.
+     */
+    CertRecord(const std::string& subject, const std::string& issuer, const std::string& not_after,
+               bool self_signed, const CertFingerprint& fingerprint = CertFingerprint());
+
+    ~CertRecord();
+
+    CertRecord(const CertRecord&) = delete;
+    CertRecord& operator=(const CertRecord&) = delete;
+
+    /** @brief True for records made from an X509 or stored with their fingerprint. */
+    bool has_fingerprint() const { return has_fingerprint_; }
+
+    /** @brief SHA-256 DER fingerprint (all zero without one). */
+    const CertFingerprint& fingerprint() const { return fingerprint_; }
+
+    const std::string& subject() const;
+    const std::string& issuer() const;
+    bool self_signed() const;
+
+    /** @brief Expiry as printed by ASN1_TIME_print(), e.g. "Jan  1 00:00:00 2030 GMT". */
+    const std::string& not_after() const;
+
+    /** @brief Expiry as a UTC timestamp, or 0 if it cannot be parsed. */
+    time_t not_after_time() const;
+
+private:
+    void parse_names() const;
+    void parse_expiry() const;
+
+    X509* x509_;
+    CertFingerprint fingerprint_;
+    bool has_fingerprint_;
+    mutable std::once_flag names_once_;
+    mutable std::once_flag expiry_once_;
+    mutable std::string subject_;
+    mutable std::string issuer_;
+    mutable std::string not_after_;
+    mutable bool self_signed_;
+    mutable time_t not_after_time_;
+};
+
+/**
+ * @brief Process-wide table interning certificates by fingerprint.
+ *
+ * A sweep over thousands of hosts behind the same load balancer or wildcard
+ * certificate keeps one CertRecord per distinct certificate. The table holds
+ * weak references, so a record lives exactly as long as some result uses it.
+ */
+class CertTable {
+public:
+    /** @brief Returns the shared table. */
+    static CertTable& instance();
+
+    /**
+     * @brief Returns the record for a certificate, creating it on first sight.
+     * @param cert Peer certificate (not freed).
+     * @return The shared record, or nullptr if the certificate cannot be digested.
+     */
+    std::shared_ptr<const CertRecord> intern(X509* cert);
+
+    /** @brief Number of distinct certificates currently in use. */
+    std::size_t size();
+
+private:
+    CertTable() : purge_at_(1024) {}
+    CertTable(const CertTable&) = delete;
+    CertTable& operator=(const CertTable&) = delete;
+
+    struct FingerprintHash {
+        std::size_t operator()(const CertFingerprint& fp) const;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<CertFingerprint, std::weak_ptr<const CertRecord>, FingerprintHash> records_;
+    std::size_t purge_at_;
+};
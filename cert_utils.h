@@ -1,24 +1,90 @@
 #pragma once
+#include "cert_table.h"
+#include <ctime>
+#include <memory>
 #include <string>
 #include <openssl/x509.h>
 
+class ResultStore;
+
 /**
  * @brief Holds information about an X.509 certificate.
+ *
+ * A handle to a shared CertRecord: copying is a reference-count increment,
+ * and every result for the same certificate points at the same record, whose
+ * fields are parsed on first access. A default-constructed CertInfo means no
+ * certificate was retrieved.
  */
-struct CertInfo {
-    bool valid;             ///< True if a certificate was retrieved.
-    std::string subject;    ///< Certificate subject.
-    std::string issuer;     ///< Certificate issuer.
-    std::string not_after;  ///< Expiry date as a string.
-    bool self_signed;       ///< True if the certificate is self-signed.
+class CertInfo {
+public:
+    CertInfo() {}
+    explicit CertInfo(std::shared_ptr<const CertRecord> record) : record_(std::move(record)) {}
+
+    /**
+     * @brief Certificate from already-known fields (e.g. read back from a store).
+     * @param fingerprint SHA-256 DER fingerprint; all zero if unknown.
+     */
+    static CertInfo from_fields(const std::string& subject, const std::string& issuer,
+                                const std::string& not_after, bool self_signed,
+                                const CertFingerprint& fingerprint = CertFingerprint());
+
+    /** @brief True if a certificate was retrieved. */
+    bool valid() const { return record_ != nullptr; }
+
+    /** @brief Certificate subject; empty if not valid. */
+    const std::string& subject() const;
+
+    /** @brief Certificate issuer; empty if not valid. */
+    const std::string& issuer() const;
+
+    /** @brief Expiry date as a string; empty if not valid. */
+    const std::string& not_after() const;
+
+    /** @brief Expiry as a UTC timestamp; 0 if not valid or unparseable. */
+    time_t not_after_time() const;
+
+    /** @brief True if the certificate is self-signed. */
+    bool self_signed() const { return record_ && record_->self_signed(); }
+
+    /** @brief The shared record, or nullptr; equal pointers mean the same certificate. */
+    const CertRecord* record() const { return record_.get(); }
+
+private:
+    std::shared_ptr<const CertRecord> record_;
 };
 
+/**
+ * @brief Logs the current OpenSSL error queue to stderr and clears it.
+ * @param context Description of where the error occurred.
+ */
+void log_ssl_errors(const std::string& context);
+
+/**
+ * @brief Looks a certificate up in the shared CertTable by fingerprint.
+ * @param cert Peer certificate (not freed).
+ * @return CertInfo referring to the interned record; fields are parsed on first access.
+ */
+CertInfo cert_info_from_x509(X509* cert);
+
 /**
  * @brief Attempts a TLS handshake and retrieves certificate information.
+ *
+ * Synchronous wrapper that runs a single handshake through CertHarvester,
+ * so timeout_sec bounds connect and handshake together.
  * 
  * @param host The hostname or IP address to connect to.
  * @param port The port to connect to (usually 443 for HTTPS).
  * @param timeout_sec Connection timeout in seconds (default: 3).
  * @return CertInfo Structure containing certificate details.
  */
-CertInfo get_cert_info(const std::string& host, int port, int timeout_sec = 3);
\ No newline at end of file
+CertInfo get_cert_info(const std::string& host, int port, int timeout_sec = 3);
+
+/**
+ * @brief Retrieves certificate information and records it in a result store.
+ * @param host The hostname or IP address to connect to.
+ * @param port The port to connect to (usually 443 for HTTPS).
+ * @param store Store that receives the result (the host is added if new).
+ * @param timeout_sec Connection timeout in seconds (default: 3).
+ * @return CertInfo Structure containing certificate details.
+ */
+CertInfo get_cert_info(const std::string& host, int port, ResultStore& store, int timeout_sec = 3);
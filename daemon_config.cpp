@@ -0,0 +1,139 @@
+#include "daemon_config.h"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief Parses a whole-string unsigned integer in [min, max].
+ */
+static bool parse_number(const std::string& text, long min, long max, long& out) {
+    char* end;
+    errno = 0;
+    long val = std::strtol(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str() || *end != '\0' || val < min || val > max) {
+        return false;
+    }
+    out = val;
+    return true;
+}
+
+/**
+ * @brief Parses "N" or "N-M" into an inclusive port range.
+ */
+static bool parse_port_range(const std::string& text, int& first, int& last) {
+    std::size_t dash = text.find('-');
+    long a, b;
+    if (!parse_number(text.substr(0, dash), 1, 65535, a)) {
+        return false;
+    }
+    b = a;
+    if (dash != std::string::npos && !parse_number(text.substr(dash + 1), a, 65535, b)) {
+        return false;
+    }
+    first = static_cast<int>(a);
+    last = static_cast<int>(b);
+    return true;
+}
+
+/** Settings whose value is a single positive integer. */
+static const char* const kIntegerSettings[] = {
+    "interval", "open_interval", "cert_interval", "expiry_days", "max_age", "timeout", "concurrency",
+};
+
+/**
+ * @brief Returns true if @p key names a setting load_daemon_config understands.
+ */
+static bool is_known_setting(const std::string& key) {
+    if (key == "targets" || key == "port" || key == "socket") {
+        return true;
+    }
+    for (const char* name : kIntegerSettings) {
+        if (key == name) return true;
+    }
+    return false;
+}
+
+bool load_daemon_config(const std::string& path, DaemonConfig& config) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: cannot read daemon config '" << path << "'.\n";
+        return false;
+    }
+
+    DaemonConfig parsed;
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        std::size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream words(line);
+        std::string key, value, extra;
+        if (!(words >> key)) {
+            continue;
+        }
+        auto fail = [&](const std::string& what) {
+            std::cerr << "Error: " << path << ":" << lineno << ": " << what << "\n";
+            return false;
+        };
+        if (!is_known_setting(key)) {
+            return fail("unknown setting '" + key + "'.");
+        }
+        if (!(words >> value)) {
+            return fail("'" + key + "' needs a value.");
+        }
+
+        if (key == "targets") {
+            if (words >> extra) return fail("targets takes one spec; separate targets with commas.");
+            parsed.targets.push_back(value);
+        } else if (key == "port") {
+            int first, last;
+            if (!parse_port_range(value, first, last)) {
+                return fail("'" + value + "' is not a port or port range (1-65535).");
+            }
+            std::string label;
+            words >> label;
+            if (words >> extra) return fail("port takes a port or range and an optional protocol label.");
+            for (int port = first; port <= last; ++port) {
+                parsed.ports.push_back({port, label});
+            }
+        } else if (key == "socket") {
+            if (words >> extra) return fail("socket takes one path.");
+            parsed.socket_path = value;
+        } else {
+            long val;
+            if (!parse_number(value, 1, INT_MAX, val) || (words >> extra)) {
+                return fail("'" + key + "' expects a positive integer.");
+            }
+            if (key == "interval") {
+                parsed.interval_s = static_cast<uint32_t>(val);
+            } else if (key == "open_interval") {
+                parsed.open_interval_s = static_cast<uint32_t>(val);
+            } else if (key == "cert_interval") {
+                parsed.cert_interval_s = static_cast<uint32_t>(val);
+            } else if (key == "expiry_days") {
+                parsed.expiry_days = static_cast<uint32_t>(val);
+            } else if (key == "max_age") {
+                parsed.max_age_s = static_cast<uint32_t>(val);
+            } else if (key == "timeout") {
+                parsed.timeout_ms = static_cast<uint32_t>(val);
+            } else {
+                parsed.concurrency = static_cast<std::size_t>(val);
+            }
+        }
+    }
+
+    if (parsed.targets.empty()) {
+        for (const auto& host : APPROVED_HOSTS) {
+            parsed.targets.push_back(host);
+        }
+    }
+    if (parsed.ports.empty()) {
+        parsed.ports = SECURE_PORTS;
+    }
+    config = parsed;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "config.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Settings for daemon mode, read from a config file.
+ *
+ * The file has one setting per line; '#' starts a comment:
+ *
+ *     targets 10.0.0.0/24,db.internal   # any target spec; may repeat
+ *     port 22 SSH                       # port with a protocol label; may repeat
+ *     port 8000-8010                    # range, connect only
+ *     interval 300                      # seconds between rescans of closed ports
+ *     open_interval 60                  # seconds between rescans of open ports
+ *     cert_interval 3600                # seconds between TLS handshakes on healthy certificates
+ *     expiry_days 30                    # certificates expiring sooner get rechecked every open_interval
+ *     max_age 30                        # cached results younger than this answer ad-hoc scans
+ *     timeout 3000                      # probe deadline in milliseconds
+ *     concurrency 256                   # connections in flight
+ *     socket /run/port_scanner.sock     # query socket path
+ *
+ * Without targets or port lines, APPROVED_HOSTS and SECURE_PORTS are used.
+ */
+struct DaemonConfig {
+    std::vector<std::string> targets;                  ///< Target specs (see target_spec.h).
+    std::vector<PortConfig> ports;                     ///< Ports scanned on every target, with protocol labels.
+    uint32_t interval_s = 300;                         ///< Rescan period for closed and filtered ports.
+    uint32_t open_interval_s = 60;                     ///< Rescan period for open ports.
+    uint32_t cert_interval_s = 3600;                   ///< TLS recheck period for certificates not near expiry.
+    uint32_t expiry_days = 30;                         ///< Certificates expiring within this window are rechecked every open_interval.
+    uint32_t max_age_s = 30;                           ///< Cached results this fresh answer ad-hoc scans without probing.
+    uint32_t timeout_ms = 3000;                        ///< Probe deadline.
+    std::size_t concurrency = 256;                     ///< Connections in flight per batch.
+    std::string socket_path = "/tmp/port_scanner.sock"; ///< Unix-domain socket for queries.
+};
+
+/**
+ * @brief Reads a daemon config file.
+ * @param path File to read.
+ * @param config Receives the settings; untouched on failure.
+ * @return false if the file cannot be read or a line is invalid (an error is printed).
+ */
+bool load_daemon_config(const std::string& path, DaemonConfig& config);
@@ -0,0 +1,367 @@
+#include "io_ring.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#ifdef PORT_SCANNER_IO_URING
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <csignal>
+
+namespace {
+
+const uint64_t kOpShift = 61;
+const uint64_t kTokenMask = (uint64_t(1) << kOpShift) - 1;
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg,
+                       std::size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+unsigned round_up_pow2(std::size_t n) {
+    unsigned p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+} // namespace
+
+IoRing::IoRing()
+    : fd_(-1), sq_entries_(0), sq_mask_(0), cq_mask_(0), sq_head_(nullptr), sq_tail_(nullptr),
+      sq_array_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), sqes_(nullptr), cqes_(nullptr),
+      sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0),
+      local_tail_(0) {}
+
+IoRing::~IoRing() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+bool IoRing::init(std::size_t slots, std::string& error) {
+    // Each probe queues at most four SQEs (socket, connect, timeout, close)
+    // and posts at most four CQEs; size the rings so a full window fits.
+    std::size_t want_sq = slots * 4 < 4096 ? slots * 4 : 4096;
+    std::size_t want_cq = slots * 4 < 65536 ? slots * 4 : 65536;
+    if (want_sq < 8) want_sq = 8;
+    if (want_cq < want_sq * 2) want_cq = want_sq * 2;
+
+    // Newer setup flags cut per-submit overhead; older kernels reject them.
+    const unsigned flag_sets[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER,
+        IORING_SETUP_CQSIZE,
+    };
+    io_uring_params p;
+    for (unsigned flags : flag_sets) {
+        std::memset(&p, 0, sizeof(p));
+        p.flags = flags;
+        p.cq_entries = round_up_pow2(want_cq);
+        fd_ = sys_io_uring_setup(round_up_pow2(want_sq), &p);
+        if (fd_ >= 0 || errno != EINVAL) break;
+    }
+    if (fd_ < 0) {
+        error = std::string("io_uring_setup() failed - ") + std::strerror(errno);
+        return false;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_CQE_SKIP) ||
+        !(p.features & IORING_FEAT_NODROP)) {
+        error = "kernel lacks io_uring EXT_ARG/CQE_SKIP/NODROP (needs Linux 5.17+)";
+        return false;
+    }
+
+    // Opcodes are probed rather than inferred from the kernel version.
+    std::vector<char> probe_buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_buf.data());
+    if (sys_io_uring_register(fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        error = std::string("IORING_REGISTER_PROBE failed - ") + std::strerror(errno);
+        return false;
+    }
+    const uint8_t needed[] = {IORING_OP_SOCKET, IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT, IORING_OP_CLOSE,
+                              IORING_OP_POLL_ADD};
+    for (uint8_t op : needed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            error = "kernel lacks io_uring socket/connect/close opcodes (needs Linux 5.19+)";
+            return false;
+        }
+    }
+
+    std::vector<int> files(slots, -1);
+    if (sys_io_uring_register(fd_, IORING_REGISTER_FILES, files.data(), static_cast<unsigned>(slots)) < 0) {
+        error = std::string("registering direct descriptors failed - ") + std::strerror(errno);
+        return false;
+    }
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+        cq_ring_size_ = sq_ring_size_;
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                    IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        error = std::string("mmap() of the submission ring failed - ") + std::strerror(errno);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            error = std::string("mmap() of the completion ring failed - ") + std::strerror(errno);
+            return false;
+        }
+    }
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        error = std::string("mmap() of the submission entries failed - ") + std::strerror(errno);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    char* cq = static_cast<char*>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = cq + p.cq_off.cqes;
+    local_tail_ = *sq_tail_;
+    // The SQ index array is an identity map; fill it once.
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+        sq_array_[i] = i;
+    }
+    timeouts_.assign(static_cast<std::size_t>(sq_entries_) * 2, 0);
+    return true;
+}
+
+/**
+ * @brief Makes room for n SQEs, submitting what is queued if the ring is full.
+ *
+ * The kernel refuses new submissions (EBUSY/EAGAIN) while its completion
+ * queue is full, and the caller only reaps between batches. So if a submit
+ * leaves too little room, ready completions are moved into backlog_ (where
+ * next_completion() still returns them) and the submit is retried.
+ * @return false if the ring failed or the queue stayed full.
+ */
+bool IoRing::reserve(unsigned n) {
+    const int kMaxAttempts = 4;
+    for (int attempt = 0;; ++attempt) {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sq_entries_ - (local_tail_ - head) >= n) {
+            return true;
+        }
+        if (attempt == kMaxAttempts) {
+            std::cerr << "Error: io_uring submission queue stays full.\n";
+            return false;
+        }
+        if (attempt > 0) {
+            Completion c;
+            while (pop_cqe(c)) {
+                backlog_.push_back(c);
+            }
+        }
+        if (!submit_and_wait(0)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Returns the next free SQE, zeroed. reserve() must have made room.
+ */
+void* IoRing::get_sqe() {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + (local_tail_ & sq_mask_);
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++local_tail_;
+    return sqe;
+}
+
+bool IoRing::queue_connect(uint32_t slot, uint64_t token, const sockaddr_storage* addr, socklen_t addr_len,
+                           uint32_t timeout_ms) {
+    // The three SQEs must reach the kernel in one submit or the link breaks.
+    if (!reserve(3)) {
+        return false;
+    }
+    io_uring_sqe* sock = static_cast<io_uring_sqe*>(get_sqe());
+    sock->opcode = IORING_OP_SOCKET;
+    sock->fd = addr->ss_family;
+    sock->off = SOCK_STREAM;
+    sock->file_index = slot + 1;
+    sock->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+    sock->user_data = token | static_cast<uint64_t>(Op::SOCKET) << kOpShift;
+
+    io_uring_sqe* conn = static_cast<io_uring_sqe*>(get_sqe());
+    conn->opcode = IORING_OP_CONNECT;
+    conn->fd = static_cast<int32_t>(slot);
+    conn->addr = reinterpret_cast<uint64_t>(addr);
+    conn->off = addr_len;
+    conn->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    conn->user_data = token | static_cast<uint64_t>(Op::CONNECT) << kOpShift;
+
+    queue_link_timeout(token, timeout_ms);
+    return true;
+}
+
+bool IoRing::queue_poll(int fd, uint32_t events, uint64_t token, uint32_t timeout_ms) {
+    if (!reserve(2)) {
+        return false;
+    }
+    io_uring_sqe* poll = static_cast<io_uring_sqe*>(get_sqe());
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = fd;
+    poll->poll32_events = events;
+    poll->flags = IOSQE_IO_LINK;
+    poll->user_data = token | static_cast<uint64_t>(Op::POLL) << kOpShift;
+
+    queue_link_timeout(token, timeout_ms);
+    return true;
+}
+
+/**
+ * @brief Queues a LINK_TIMEOUT for the SQE just queued; reserve() must have made room.
+ */
+void IoRing::queue_link_timeout(uint64_t token, uint32_t timeout_ms) {
+    unsigned index = local_tail_ & sq_mask_;
+    __kernel_timespec* ts = reinterpret_cast<__kernel_timespec*>(&timeouts_[index * 2]);
+    ts->tv_sec = timeout_ms / 1000;
+    ts->tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+    io_uring_sqe* timeout = static_cast<io_uring_sqe*>(get_sqe());
+    timeout->opcode = IORING_OP_LINK_TIMEOUT;
+    timeout->addr = reinterpret_cast<uint64_t>(ts);
+    timeout->len = 1;
+    timeout->user_data = token | static_cast<uint64_t>(Op::TIMEOUT) << kOpShift;
+}
+
+bool IoRing::queue_close(uint32_t slot, uint64_t token) {
+    if (!reserve(1)) {
+        return false;
+    }
+    // Direct-descriptor closes run inline during submit, in queue order, so a
+    // later socket for the same slot always lands after this close.
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(get_sqe());
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = token | static_cast<uint64_t>(Op::CLOSE) << kOpShift;
+    return true;
+}
+
+bool IoRing::submit_and_wait(int wait_ms) {
+    if (!backlog_.empty()) {
+        wait_ms = 0; // completions are already waiting to be returned
+    }
+    __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    const void* argp = nullptr;
+    std::size_t argsz = 0;
+    if (wait_ms != 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if (wait_ms > 0) {
+            ts.tv_sec = wait_ms / 1000;
+            ts.tv_nsec = static_cast<long long>(wait_ms % 1000) * 1000000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            arg.sigmask_sz = _NSIG / 8;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+    for (;;) {
+        unsigned pending = local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        int ret = sys_io_uring_enter(fd_, pending, min_complete, flags, argp, argsz);
+        if (ret >= 0) {
+            return true;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        // ETIME: the wait timed out. EBUSY/EAGAIN: completions must be reaped first.
+        if (errno == ETIME || errno == EBUSY || errno == EAGAIN) {
+            return true;
+        }
+        std::cerr << "Error: io_uring_enter() failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+}
+
+/**
+ * @brief Pops one completion off the CQ ring.
+ */
+bool IoRing::pop_cqe(Completion& out) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & cq_mask_);
+    out.token = cqe->user_data & kTokenMask;
+    out.op = static_cast<Op>(cqe->user_data >> kOpShift);
+    out.res = cqe->res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool IoRing::next_completion(uint64_t& token, Op& op, int32_t& res) {
+    Completion c;
+    if (!backlog_.empty()) {
+        c = backlog_.front();
+        backlog_.pop_front();
+    } else if (!pop_cqe(c)) {
+        return false;
+    }
+    token = c.token;
+    op = c.op;
+    res = c.res;
+    return true;
+}
+
+#else // !PORT_SCANNER_IO_URING
+
+IoRing::IoRing()
+    : fd_(-1), sq_entries_(0), sq_mask_(0), cq_mask_(0), sq_head_(nullptr), sq_tail_(nullptr),
+      sq_array_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), sqes_(nullptr), cqes_(nullptr),
+      sq_ring_(nullptr), cq_ring_(nullptr), sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0),
+      local_tail_(0) {}
+
+IoRing::~IoRing() {}
+
+bool IoRing::init(std::size_t, std::string& error) {
+    error = "built without io_uring support";
+    return false;
+}
+
+bool IoRing::queue_connect(uint32_t, uint64_t, const sockaddr_storage*, socklen_t, uint32_t) { return false; }
+bool IoRing::queue_poll(int, uint32_t, uint64_t, uint32_t) { return false; }
+bool IoRing::queue_close(uint32_t, uint64_t) { return false; }
+bool IoRing::submit_and_wait(int) { return false; }
+bool IoRing::next_completion(uint64_t&, Op&, int32_t&) { return false; }
+void* IoRing::get_sqe() { return nullptr; }
+bool IoRing::reserve(unsigned) { return false; }
+bool IoRing::pop_cqe(Completion&) { return false; }
+void IoRing::queue_link_timeout(uint64_t, uint32_t) {}
+
+#endif // PORT_SCANNER_IO_URING
@@ -0,0 +1,127 @@
+#pragma once
+#include <sys/socket.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Minimal io_uring submission/completion ring for connect probes.
+ *
+ * Talks to the kernel through the raw io_uring_setup/io_uring_enter/
+ * io_uring_register system calls, so it needs no library beyond the
+ * kernel's UAPI header. Each probe is one linked chain, socket → connect
+ * → link timeout, on a direct descriptor (a slot in the ring's registered
+ * file table instead of the process fd table), and its close is queued
+ * with the next batch. A whole window of chains and closes goes to the
+ * kernel in one io_uring_enter() call, which also reaps completions.
+ *
+ * Probes that keep talking after the connect (see ConnectHook) need an
+ * ordinary descriptor instead: the caller creates and connects the socket
+ * itself and queues each wait for readiness as a poll with a linked timeout.
+ *
+ * The ring is set up single-issuer: only the creating thread may use it.
+ *
+ * Built only when PORT_SCANNER_IO_URING is defined (see CMakeLists.txt);
+ * otherwise init() always fails and callers fall back to epoll.
+ */
+class IoRing {
+public:
+    /// Operation a completion belongs to; stored in the top three bits of its user data.
+    enum class Op : uint64_t { SOCKET = 0, CONNECT = 1, TIMEOUT = 2, CLOSE = 3, POLL = 4 };
+
+    IoRing();
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    /**
+     * @brief Creates the ring and a sparse table of direct descriptors.
+     * @param slots Number of direct descriptors, i.e. probes in flight at once.
+     * @param error Reason on failure (kernel too old, io_uring disabled, ...).
+     * @return false if the kernel lacks any feature the probe chain needs.
+     */
+    bool init(std::size_t slots, std::string& error);
+
+    /**
+     * @brief Queues socket → connect → timeout for one probe.
+     * @param slot Direct descriptor to create the socket in.
+     * @param token User data for all three completions; the Op is or'ed in.
+     * @param addr Target address; must stay valid until the next submit.
+     * @param addr_len Length of addr.
+     * @param timeout_ms Deadline after which the connect completes with -ECANCELED.
+     * @return false if the ring failed.
+     */
+    bool queue_connect(uint32_t slot, uint64_t token, const sockaddr_storage* addr, socklen_t addr_len,
+                       uint32_t timeout_ms);
+
+    /**
+     * @brief Queues a one-shot wait for readiness on an ordinary descriptor, with a timeout.
+     * @param fd Socket to watch.
+     * @param events POLLIN and/or POLLOUT.
+     * @param token User data for both completions; the Op is or'ed in.
+     * @param timeout_ms Deadline after which the poll completes with -ECANCELED.
+     * @return false if the ring failed. The POLL completion carries the ready events.
+     */
+    bool queue_poll(int fd, uint32_t events, uint64_t token, uint32_t timeout_ms);
+
+    /**
+     * @brief Queues closing a slot's socket; only failures produce a completion.
+     * @return false if the ring failed.
+     */
+    bool queue_close(uint32_t slot, uint64_t token);
+
+    /**
+     * @brief Submits everything queued and waits for at least one completion.
+     *
+     * Does not wait while completions set aside by a full queue are pending.
+     * If the kernel is busy (EBUSY/EAGAIN) nothing may have been submitted;
+     * reap with next_completion() and call again.
+     * @param wait_ms Longest wait; negative waits indefinitely, 0 only submits.
+     * @return false on a ring error (an error is printed).
+     */
+    bool submit_and_wait(int wait_ms);
+
+    /**
+     * @brief Pops the next completion, oldest first.
+     * @param token User data given when the operation was queued.
+     * @param op Which operation of the chain completed.
+     * @param res Result: 0 or a new descriptor on success, -errno on failure.
+     * @return false once no completions are ready.
+     */
+    bool next_completion(uint64_t& token, Op& op, int32_t& res);
+
+private:
+    struct Completion {
+        uint64_t token;
+        Op op;
+        int32_t res;
+    };
+
+    void* get_sqe();
+    bool reserve(unsigned n);
+    void queue_link_timeout(uint64_t token, uint32_t timeout_ms);
+    bool pop_cqe(Completion& out);
+
+    int fd_;
+    unsigned sq_entries_;
+    unsigned sq_mask_;
+    unsigned cq_mask_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    void* sqes_;
+    void* cqes_;
+    void* sq_ring_;
+    void* cq_ring_;
+    std::size_t sq_ring_size_;
+    std::size_t cq_ring_size_;
+    std::size_t sqes_size_;
+    unsigned local_tail_;       ///< Tail including SQEs filled but not yet published to the kernel.
+    std::vector<int64_t> timeouts_; ///< One kernel timespec (sec, nsec) per SQE slot.
+    std::deque<Completion> backlog_; ///< Completions moved off the CQ ring by reserve(), not yet returned.
+};
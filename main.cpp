@@ -1,27 +1,84 @@
 #include "scanner.h"
+#include "scan_engine.h"
 #include "config.h"
 #include "cert_utils.h"
+#include "sharded_scanner.h"
+#include "target_spec.h"
+#include "syn_scanner.h"
+#include "result_sink.h"
+#include "result_store.h"
+#include "metrics.h"
+#include "scan_journal.h"
+#include "scan_diff.h"
+#include "service_probe.h"
+#include "target_order.h"
+#include "scan_daemon.h"
 #include <iostream>
 #include <vector>
 #include <string>
 #include <cstdlib> // for std::strtol
 #include <cerrno>
 #include <climits>
+#include <random>
+#include <unordered_map>
 
 /**
  * @file main.cpp
  * @brief Entry point for the port scanner application.
  *
  * Usage:
- *   ./port_scanner <host> <start_port> <end_port>
- *     - Scans the specified host and port range.
+ *   ./port_scanner [options] <targets> <start_port> <end_port>
+ *     - Scans the specified targets and port range.
+ *     - <targets> is a host, a CIDR block, a comma-separated list of either,
+ *       or @file with one per line (see target_spec.h).
  *     - Example: ./port_scanner 127.0.0.1 8000 8000
+ *     - Example: ./port_scanner --threads 4 10.0.0.0/20 22 22
+ *
+ *   Options:
+ *     --threads N       Worker threads / event loops (default: one per core).
+ *     --concurrency N   Total connects in flight across all workers (default: 1024).
+ *     --rate N          Maximum probes per second across all workers (default: unlimited).
+ *     --timeout MS      Deadline before a target's RTT is known; later deadlines
+ *                       adapt to the measured RTT (default: 3000).
+ *     --syn             Half-open scan over a raw socket (IPv4, needs CAP_NET_RAW).
+ *     --io-uring        Submit connect probes through io_uring (Linux 5.19+); falls
+ *                       back to epoll with a note if the kernel cannot.
+ *     --format F        Output format: text (default), jsonl or binary (see scan_record.h).
+ *     --output PATH     Write results to PATH instead of stdout.
+ *     --async-writer    Write output from a background thread.
+ *     --store PATH      Also save results as a memory-mappable bitmap store (see result_store.h).
+ *     --metrics-file PATH  Write Prometheus-format metrics to PATH when the scan ends.
+ *     --metrics-port N  Serve Prometheus metrics on http://127.0.0.1:N/metrics during the scan.
+ *     --journal PATH    Checkpoint progress to PATH; rerunning the same scan resumes
+ *                       from it. Removed once the scan completes (not with --syn).
+ *     --diff PREV       Report only changes against a store saved by --store: ports
+ *                       that opened or closed, and certificates that changed or expire
+ *                       soon. Previously open ports are reprobed first.
+ *     --expiry-days N   Certificate expiry warning window for --diff (default: 30).
+ *     --randomize       Probe hosts x ports in pseudo-random order (see target_order.h);
+ *                       results are printed in that order. SECURE_PORTS go first
+ *                       unless --priority-ports is given.
+ *     --seed N          Randomize with a fixed permutation seed (implies --randomize).
+ *     --shard I/N       Scan only slice I (0-based) of N disjoint slices; shards of a
+ *                       randomized scan must share --seed.
+ *     --priority-ports LIST  Comma-separated ports probed on every host before the rest.
+ *
+ *   ./port_scanner --daemon CONFIG [--format F] [--metrics-port N]
+ *     - Runs continuously: rescans the targets and ports in CONFIG (see
+ *       daemon_config.h) and answers queries on a Unix-domain socket in
+ *       format F (see scan_daemon.h). SIGHUP reloads CONFIG.
+ *
+ *   ./port_scanner --query SOCKET <command...>
+ *     - Sends one command to a running daemon, e.g. "status" or
+ *       "scan 10.0.0.5 22,443", and prints the reply.
  *
  *   ./port_scanner
  *     - Scans the default APPROVED_HOSTS and SECURE_PORTS from config.h.
  *
- * For HTTPS ports, attempts a TLS handshake and retrieves certificate information.
- * For other ports, performs a basic TCP port scan.
+ * In the default scan each configured port is probed once: SSH, VNC and RDP
+ * ports are checked for their protocol's greeting on the connection that found
+ * them open, and HTTPS ports get a TLS handshake on that same connection to
+ * retrieve certificate information.
  */
 
 /**
@@ -46,16 +103,203 @@ static bool parse_port(const char* str, int& out) {
     return true;
 }
 
+/**
+ * @brief Parses a shard selector "I/N" with 0 <= I < N.
+ * @param str String to parse.
+ * @param options Receives shard and shards on success.
+ * @return true on success, false if invalid.
+ */
+static bool parse_shard(const char* str, TargetOrderOptions& options) {
+    char* slash;
+    char* end;
+    errno = 0;
+    long shard = std::strtol(str, &slash, 10);
+    long shards = (errno == 0 && slash != str && *slash == '/') ? std::strtol(slash + 1, &end, 10) : 0;
+    if (errno != 0 || shards < 1 || *end != '\0' || end == slash + 1 || shard < 0 || shard >= shards ||
+        shards > INT_MAX) {
+        std::cerr << "Error: --shard expects I/N with 0 <= I < N, got '" << str << "'.\n";
+        return false;
+    }
+    options.shard = static_cast<unsigned>(shard);
+    options.shards = static_cast<unsigned>(shards);
+    return true;
+}
+
+/**
+ * @brief Parses a comma-separated port list such as "22,443,3389".
+ * @param str String to parse.
+ * @param out Ports in the order given.
+ * @return true on success, false if any entry is invalid.
+ */
+static bool parse_port_list(const char* str, std::vector<int>& out) {
+    std::string list = str;
+    std::size_t begin = 0;
+    for (;;) {
+        std::size_t comma = list.find(',', begin);
+        std::string item = list.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin);
+        int port;
+        if (!parse_port(item.c_str(), port)) {
+            return false;
+        }
+        out.push_back(port);
+        if (comma == std::string::npos) {
+            return true;
+        }
+        begin = comma + 1;
+    }
+}
+
+/**
+ * @brief Parses a positive count (threads, concurrency, rate, timeout) from a string.
+ * @param name Option name, for error messages.
+ * @param str String to parse.
+ * @param out Output value on success.
+ * @return true on success, false if invalid.
+ */
+static bool parse_count(const char* name, const char* str, long& out) {
+    char* end;
+    errno = 0;
+    long val = std::strtol(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || val < 1) {
+        std::cerr << "Error: " << name << " expects a positive integer, got '" << str << "'.\n";
+        return false;
+    }
+    out = val;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     std::vector<std::string> hosts;
     int port_start = -1, port_end = -1;
+    ShardedScanOptions scan_options;
+    bool syn_mode = false;
+    bool async_writer = false;
+    std::string format = "text";
+    std::string output_path;
+    std::string store_path;
+    std::string metrics_path;
+    int metrics_port = 0;
+    std::string journal_path;
+    std::string diff_path;
+    long expiry_days = 30;
+    TargetOrderOptions order_options;
+    bool seed_given = false;
+    bool priority_given = false;
+    std::string daemon_config;
+    std::string query_socket;
+
+    // Strip "--name value" options; whatever remains is positional.
+    std::vector<char*> args;
+    args.push_back(argv[0]);
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (opt.compare(0, 2, "--") != 0) {
+            args.push_back(argv[i]);
+            continue;
+        }
+        if (opt == "--syn") {
+            syn_mode = true;
+            continue;
+        }
+        if (opt == "--async-writer") {
+            async_writer = true;
+            continue;
+        }
+        if (opt == "--io-uring") {
+            scan_options.engine.io_uring = true;
+            continue;
+        }
+        if (opt == "--randomize") {
+            order_options.randomize = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: option " << opt << " requires a value.\n";
+            return 1;
+        }
+        long val = 0;
+        if (opt == "--threads") {
+            if (!parse_count("--threads", argv[++i], val)) return 1;
+            scan_options.threads = static_cast<unsigned>(val);
+        } else if (opt == "--concurrency") {
+            if (!parse_count("--concurrency", argv[++i], val)) return 1;
+            scan_options.engine.max_in_flight = static_cast<std::size_t>(val);
+        } else if (opt == "--rate") {
+            if (!parse_count("--rate", argv[++i], val)) return 1;
+            scan_options.engine.rate_limit = static_cast<double>(val);
+        } else if (opt == "--timeout") {
+            if (!parse_count("--timeout", argv[++i], val)) return 1;
+            scan_options.engine.timeout_ms = static_cast<uint32_t>(val);
+        } else if (opt == "--format") {
+            format = argv[++i];
+        } else if (opt == "--output") {
+            output_path = argv[++i];
+        } else if (opt == "--store") {
+            store_path = argv[++i];
+        } else if (opt == "--metrics-file") {
+            metrics_path = argv[++i];
+        } else if (opt == "--metrics-port") {
+            if (!parse_port(argv[++i], metrics_port)) return 1;
+        } else if (opt == "--journal") {
+            journal_path = argv[++i];
+        } else if (opt == "--diff") {
+            diff_path = argv[++i];
+        } else if (opt == "--expiry-days") {
+            if (!parse_count("--expiry-days", argv[++i], expiry_days)) return 1;
+        } else if (opt == "--seed") {
+            if (!parse_count("--seed", argv[++i], val)) return 1;
+            order_options.randomize = true;
+            order_options.seed = static_cast<uint64_t>(val);
+            seed_given = true;
+        } else if (opt == "--shard") {
+            if (!parse_shard(argv[++i], order_options)) return 1;
+        } else if (opt == "--priority-ports") {
+            if (!parse_port_list(argv[++i], order_options.priority_ports)) return 1;
+            priority_given = true;
+        } else if (opt == "--daemon") {
+            daemon_config = argv[++i];
+        } else if (opt == "--query") {
+            query_socket = argv[++i];
+        } else {
+            std::cerr << "Error: unknown option '" << opt << "'.\n";
+            return 1;
+        }
+    }
+
+    if (!query_socket.empty()) {
+        if (args.size() == 1) {
+            std::cerr << "Error: --query needs a command, e.g. 'status' or 'scan <targets> <ports>'.\n";
+            return 1;
+        }
+        std::string command = args[1];
+        for (std::size_t i = 2; i < args.size(); ++i) {
+            command += ' ';
+            command += args[i];
+        }
+        return daemon_query(query_socket, command) ? 0 : 1;
+    }
+    if (!daemon_config.empty()) {
+        if (args.size() != 1) {
+            std::cerr << "Error: --daemon takes its targets and ports from the config file.\n";
+            return 1;
+        }
+        MetricsHttpServer metrics_server;
+        if (metrics_port > 0 && !metrics_server.start(metrics_port)) {
+            return 1;
+        }
+        ScanDaemon daemon(daemon_config, format);
+        if (!daemon.start()) {
+            return 1;
+        }
+        return daemon.run() ? 0 : 1;
+    }
 
-    if (argc == 1) {
+    if (args.size() == 1) {
         // Use defaults from config.h
         hosts = APPROVED_HOSTS;
-    } else if (argc == 4) {
-        // Usage: ./port_scanner <host> <start_port> <end_port>
-        if (!parse_port(argv[2], port_start) || !parse_port(argv[3], port_end)) {
+    } else if (args.size() == 4) {
+        // Usage: ./port_scanner [options] <targets> <start_port> <end_port>
+        if (!parse_port(args[2], port_start) || !parse_port(args[3], port_end)) {
             return 1;
         }
         if (port_start > port_end) {
@@ -63,48 +307,276 @@ int main(int argc, char* argv[]) {
                       << ") must be <= end_port (" << port_end << ").\n";
             return 1;
         }
-        hosts.push_back(argv[1]);
+        hosts.push_back(args[1]);
     } else {
         std::cerr << "Usage:\n"
-                  << "  " << argv[0] << "                          # scan default hosts/ports\n"
-                  << "  " << argv[0] << " <host> <start> <end>     # scan custom host and port range\n";
+                  << "  " << argv[0] << "                                    # scan default hosts/ports\n"
+                  << "  " << argv[0] << " [options] <targets> <start> <end>  # scan custom targets and port range\n"
+                  << "Targets: host | CIDR | comma-separated list | @file\n"
+                  << "Options: --threads N  --concurrency N  --rate N  --timeout MS  --syn  --io-uring\n"
+                  << "         --format text|jsonl|binary  --output PATH  --async-writer  --store PATH\n"
+                  << "         --metrics-file PATH  --metrics-port N\n"
+                  << "         --journal PATH  --diff PREV  --expiry-days N\n"
+                  << "         --randomize  --seed N  --shard I/N  --priority-ports LIST\n"
+                  << "  " << argv[0] << " --daemon CONFIG [--format F]        # rescan continuously, serve queries\n"
+                  << "  " << argv[0] << " --query SOCKET <command...>         # ask a running daemon\n";
+        return 1;
+    }
+
+    if (!journal_path.empty() && (syn_mode || port_start < 0)) {
+        std::cerr << "Error: --journal needs a connect scan of a port range (not --syn or the default scan).\n";
+        return 1;
+    }
+    if (port_start < 0 && (order_options.randomize || order_options.shards > 1 || priority_given)) {
+        std::cerr << "Error: --randomize, --seed, --shard and --priority-ports need a port range.\n";
+        return 1;
+    }
+    if (order_options.randomize && order_options.shards > 1 && !seed_given) {
+        std::cerr << "Error: --shard with --randomize needs --seed so every shard walks the same order.\n";
+        return 1;
+    }
+
+    std::unique_ptr<ResultSink> sink = make_result_sink(format, output_path, async_writer);
+    if (!sink) {
+        return 1;
+    }
+    const bool diff_mode = !diff_path.empty();
+    ScanDiff diff(static_cast<int>(expiry_days));
+    if (diff_mode && !diff.load(diff_path)) {
+        return 1;
+    }
+    std::size_t changes = 0;
+    ResultStore store;
+    const bool keep_store = !store_path.empty();
+    MetricsHttpServer metrics_server;
+    if (metrics_port > 0 && !metrics_server.start(metrics_port)) {
         return 1;
     }
 
     if (port_start > 0 && port_end > 0) {
-        for (const auto& host : hosts) {
-            for (int port = port_start; port <= port_end; ++port) {
-                PortStatus status = scan_port(host, port);
-                std::cout << "Host: " << host
-                          << " Port: " << port
-                          << " Status: " << status_to_string(status)
-                          << std::endl;
+        std::vector<HostEntry> targets;
+        if (!parse_targets(hosts[0], targets)) {
+            return 1;
+        }
+        std::vector<int> ports;
+        for (int port = port_start; port <= port_end; ++port) {
+            ports.push_back(port);
+        }
+        if (order_options.randomize && !priority_given) {
+            for (const auto& portcfg : SECURE_PORTS) {
+                order_options.priority_ports.push_back(portcfg.port);
+            }
+        }
+        if (order_options.randomize && !seed_given) {
+            if (journal_path.empty()) {
+                std::random_device rd;
+                order_options.seed = static_cast<uint64_t>(rd()) << 32 | rd();
+            } else {
+                // A journaled scan must walk the same order when rerun.
+                order_options.seed = scan_fingerprint(targets, ports);
+            }
+        }
+        const TargetOrder order(targets.size(), ports, order_options);
+        scan_options.order = &order;
+
+        const std::string no_protocol;
+        auto report_change = [&](const HostEntry& host, int port, PortStatus status) {
+            PortState previous;
+            if (diff.port_changed(host.name, port, status, previous)) {
+                sink->port_change(host, port, no_protocol, previous, status);
+                ++changes;
+            }
+        };
+
+        // Diff mode: reprobe what was open last time before sweeping the
+        // whole range, so services that went away are reported first.
+        std::unordered_map<uint64_t, PortStatus> reprobed;
+        auto reprobe_key = [&targets](const HostEntry& host, int port) {
+            return static_cast<uint64_t>(&host - targets.data()) << 16 | static_cast<uint64_t>(port);
+        };
+        if (diff_mode) {
+            ScanEngineOptions engine_options = scan_options.engine;
+            engine_options.max_in_flight = clamp_to_fd_limit(engine_options.max_in_flight);
+            ScanEngine engine(engine_options);
+            std::vector<std::size_t> engine_hosts;
+            for (std::size_t h = 0; h < targets.size(); ++h) {
+                std::vector<int> open_ports = diff.previously_open(targets[h].name, port_start, port_end);
+                if (open_ports.empty() || targets[h].addr.family == AF_UNSPEC) {
+                    continue;
+                }
+                sockaddr_storage addr;
+                socklen_t addr_len = targets[h].addr.to_sockaddr(0, addr);
+                std::size_t target = engine.add_target(targets[h].name, addr, addr_len);
+                engine_hosts.push_back(h);
+                for (int port : open_ports) {
+                    engine.submit(target, port);
+                }
+            }
+            bool reprobe_ok = engine.run([&](const ScanResult& r) {
+                const HostEntry& host = targets[engine_hosts[r.target]];
+                reprobed[reprobe_key(host, r.port)] = r.status;
+                report_change(host, r.port, r.status);
+            });
+            if (!reprobe_ok) {
+                return 1;
+            }
+            sink->flush();
+            scan_options.known = [&](const HostEntry& host, int port, PortStatus& status) {
+                auto it = reprobed.find(reprobe_key(host, port));
+                if (it == reprobed.end()) {
+                    return false;
+                }
+                status = it->second;
+                return true;
+            };
+        }
+
+        // Unless randomized, results arrive host by host, so the store index
+        // is usually looked up once per host.
+        const HostEntry* last_host = nullptr;
+        std::size_t store_index = 0;
+        auto print = [&](const HostEntry& host, int port, PortStatus status) {
+            if (!diff_mode) {
+                sink->port_result(host, port, no_protocol, status);
+            } else if (reprobed.find(reprobe_key(host, port)) == reprobed.end()) {
+                report_change(host, port, status);
+            }
+            if (keep_store) {
+                if (&host != last_host) {
+                    store_index = store.add_host(host);
+                    last_host = &host;
+                }
+                store.record(store_index, port, status);
+            }
+        };
+        bool ok;
+        if (syn_mode) {
+            SynScanOptions syn_options;
+            syn_options.timeout_ms = scan_options.engine.timeout_ms;
+            syn_options.rate_limit = scan_options.engine.rate_limit;
+            ok = syn_scan(targets, ports, order, syn_options, print);
+        } else {
+            // Shard the hosts x ports matrix across one event loop per core;
+            // results come back in scan order.
+            ScanJournal journal;
+            if (!journal_path.empty()) {
+                std::size_t total = static_cast<std::size_t>(order.positions());
+                std::size_t chunk_size = ShardedScanner::default_chunk_size(total, scan_options.threads,
+                                                                            scan_options.min_chunk);
+                if (!journal.open(journal_path, scan_fingerprint(targets, ports) ^ order.fingerprint(), total,
+                                  chunk_size)) {
+                    return 1;
+                }
+                if (journal.resumed()) {
+                    std::cerr << "Resuming from journal '" << journal_path << "': " << journal.chunks_done()
+                              << " of " << journal.num_chunks() << " chunks already scanned.\n";
+                }
+                scan_options.journal = &journal;
+            }
+            ShardedScanner scanner(targets, ports, scan_options);
+            ok = scanner.run(print);
+            if (ok && scan_options.journal) {
+                journal.remove();
             }
         }
+        if (!ok) {
+            return 1;
+        }
     } else {
-        for (const auto& host : hosts) {
+        // Probe every configured port on one event loop, identifying the
+        // service (or handshaking, for HTTPS) on the connection that found it
+        // open, then report in host/config order.
+        const std::size_t nports = SECURE_PORTS.size();
+        std::vector<HostEntry> entries(hosts.size());
+        std::vector<PortStatus> statuses(hosts.size() * nports, PortStatus::CLOSED);
+        std::vector<std::string> services(hosts.size() * nports);
+        std::vector<CertInfo> certs(hosts.size() * nports, CertInfo());
+        std::vector<std::size_t> prober_hosts;
+        ServiceProberOptions prober_options;
+        prober_options.timeout_ms = scan_options.engine.timeout_ms;
+        prober_options.max_in_flight = scan_options.engine.max_in_flight;
+        prober_options.rate_limit = scan_options.engine.rate_limit;
+        prober_options.io_uring = scan_options.engine.io_uring;
+        ServiceProber prober(prober_options);
+        for (std::size_t h = 0; h < hosts.size(); ++h) {
+            entries[h].name = hosts[h];
+            if (!default_target_cache().lookup(hosts[h], entries[h].addr)) {
+                continue;
+            }
+            sockaddr_storage addr;
+            socklen_t addr_len = entries[h].addr.to_sockaddr(0, addr);
+            std::size_t target = prober.add_target(hosts[h], addr, addr_len);
+            prober_hosts.push_back(h);
             for (const auto& portcfg : SECURE_PORTS) {
+                prober.submit(target, portcfg.port, service_protocol_for(portcfg.protocol));
+            }
+        }
+        auto slot_of = [&](std::size_t host, int port) {
+            std::size_t c = 0;
+            while (c < nports && SECURE_PORTS[c].port != port) ++c;
+            return host * nports + c;
+        };
+        bool probe_ok = prober.run([&](const ServiceResult& r) {
+            std::size_t slot = slot_of(prober_hosts[r.target], r.port);
+            statuses[slot] = r.status;
+            if (r.identified) services[slot].assign(r.banner, r.banner_len);
+            certs[slot] = r.cert;
+        });
+        if (!probe_ok) {
+            return 1;
+        }
+
+        for (std::size_t h = 0; h < hosts.size(); ++h) {
+            std::size_t store_index = keep_store ? store.add_host(entries[h]) : 0;
+            for (std::size_t c = 0; c < nports; ++c) {
+                const auto& portcfg = SECURE_PORTS[c];
+                // The connect result is the port's status; the certificate
+                // only feeds the cert report and cert diff, so a port that
+                // accepted the connection but failed the handshake stays OPEN.
+                const PortStatus status = statuses[h * nports + c];
                 if (portcfg.protocol == "HTTPS") {
-                    CertInfo cert = get_cert_info(host, portcfg.port);
-                    std::cout << "Host: " << host
-                              << " Port: " << portcfg.port
-                              << " (" << portcfg.protocol << ")"
-                              << " Cert valid: " << (cert.valid ? "yes" : "no")
-                              << " Subject: " << cert.subject
-                              << " Issuer: " << cert.issuer
-                              << " Expiry: " << cert.not_after
-                              << " Self-signed: " << (cert.self_signed ? "yes" : "no")
-                              << std::endl;
+                    const CertInfo& cert = certs[h * nports + c];
+                    if (keep_store) {
+                        store.record(store_index, portcfg.port, status);
+                        store.record_cert(store_index, portcfg.port, cert);
+                    }
+                    if (!diff_mode) {
+                        sink->cert_result(entries[h], portcfg.port, portcfg.protocol, cert);
+                        continue;
+                    }
+                    PortState previous;
+                    std::string reason;
+                    if (diff.port_changed(hosts[h], portcfg.port, status, previous)) {
+                        sink->port_change(entries[h], portcfg.port, portcfg.protocol, previous, status);
+                        ++changes;
+                    }
+                    if (diff.cert_changed(hosts[h], portcfg.port, cert, reason)) {
+                        sink->cert_change(entries[h], portcfg.port, portcfg.protocol, cert, reason);
+                        ++changes;
+                    }
                 } else {
-                    PortStatus status = scan_port(host, portcfg.port);
-                    std::cout << "Host: " << host
-                              << " Port: " << portcfg.port
-                              << " (" << portcfg.protocol << ")"
-                              << " Status: " << status_to_string(status)
-                              << std::endl;
+                    if (keep_store) store.record(store_index, portcfg.port, status);
+                    PortState previous;
+                    if (!diff_mode) {
+                        sink->service_result(entries[h], portcfg.port, portcfg.protocol, status,
+                                             services[h * nports + c]);
+                    } else if (diff.port_changed(hosts[h], portcfg.port, status, previous)) {
+                        sink->port_change(entries[h], portcfg.port, portcfg.protocol, previous, status);
+                        ++changes;
+                    }
                 }
             }
         }
     }
+    if (diff_mode && changes == 0) {
+        sink->note("No changes detected");
+    }
+    sink->flush();
+    if (keep_store && !store.save(store_path)) {
+        return 1;
+    }
+    if (!metrics_path.empty() && !write_metrics_file(metrics_path)) {
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief One thread's counters.
+ *
+ * Only the owning thread writes a shard, so updates are a relaxed load and
+ * store rather than a locked read-modify-write; readers may see a value that
+ * is one update behind, never a torn one.
+ */
+struct MetricsShard {
+    std::atomic<uint64_t> buckets[kMetricPhaseCount][LatencyHistogram::kBuckets];
+    std::atomic<uint64_t> count[kMetricPhaseCount];
+    std::atomic<uint64_t> sum_us[kMetricPhaseCount];
+    std::atomic<uint64_t> status[3];
+    std::atomic<uint64_t> errors[kMetricMaxErrno + 1];
+    std::atomic<uint64_t> ssl_errors;
+    bool in_use;  ///< Guarded by Registry::mutex.
+};
+
+inline void bump(std::atomic<uint64_t>& v, uint64_t n = 1) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Every shard ever created. Shards of exited threads are reused by new
+ *        threads, so counts stay cumulative and memory stays bounded by the
+ *        peak number of live threads.
+ */
+struct Registry {
+    std::mutex mutex;
+    std::vector<MetricsShard*> shards;
+};
+
+Registry& registry() {
+    // Leaked on purpose: threads may still record after static destruction.
+    static Registry* r = new Registry;
+    return *r;
+}
+
+struct ShardHandle {
+    MetricsShard* shard;
+
+    ShardHandle() : shard(nullptr) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (MetricsShard* s : r.shards) {
+            if (!s->in_use) {
+                shard = s;
+                break;
+            }
+        }
+        if (!shard) {
+            shard = new MetricsShard();  // value-initialised: all counters zero
+            r.shards.push_back(shard);
+        }
+        shard->in_use = true;
+    }
+
+    ~ShardHandle() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        shard->in_use = false;
+    }
+};
+
+MetricsShard& local_shard() {
+    thread_local ShardHandle handle;
+    return *handle.shard;
+}
+
+const char* const kPhaseNames[kMetricPhaseCount] = {
+    "dns_resolve", "socket_create", "connect", "tls_handshake", "cert_parse",
+};
+
+const char* const kStatusNames[3] = {"open", "closed", "filtered"};
+
+std::string errno_label(int err) {
+    if (err == kMetricMaxErrno) {
+        return "other";
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 32))
+    const char* name = strerrorname_np(err);
+    if (name) {
+        return name;
+    }
+#endif
+    return std::to_string(err);
+}
+
+void append_metric(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void append_metric(std::string& out, const char* fmt, ...) {
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out.append(line, static_cast<std::size_t>(n) < sizeof(line) ? static_cast<std::size_t>(n) : sizeof(line) - 1);
+    }
+}
+
+} // namespace
+
+std::size_t LatencyHistogram::bucket_of(uint64_t us) {
+    if (us < kSubBuckets) {
+        return static_cast<std::size_t>(us);
+    }
+    unsigned e = 63u - static_cast<unsigned>(__builtin_clzll(us));  // e >= 4
+    std::size_t b = kSubBuckets + (e - 4) * kSubBuckets + ((us >> (e - 4)) & (kSubBuckets - 1));
+    return b < kBuckets ? b : kBuckets - 1;
+}
+
+uint64_t LatencyHistogram::bucket_upper(std::size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    unsigned e = static_cast<unsigned>((bucket - kSubBuckets) / kSubBuckets) + 4;
+    uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + sub) << (e - 4)) + (1ull << (e - 4)) - 1;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b < kBuckets; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            return bucket_upper(b);
+        }
+    }
+    return bucket_upper(kBuckets - 1);
+}
+
+void metrics_record(MetricPhase phase, uint64_t us) {
+    MetricsShard& s = local_shard();
+    std::size_t p = static_cast<std::size_t>(phase);
+    bump(s.buckets[p][LatencyHistogram::bucket_of(us)]);
+    bump(s.count[p]);
+    bump(s.sum_us[p], us);
+}
+
+void metrics_count_status(PortStatus status) {
+    bump(local_shard().status[static_cast<std::size_t>(status)]);
+}
+
+void metrics_count_errno(int err) {
+    bump(local_shard().errors[err > 0 && err < kMetricMaxErrno ? err : kMetricMaxErrno]);
+}
+
+void metrics_count_ssl_errors(uint64_t n) {
+    if (n) bump(local_shard().ssl_errors, n);
+}
+
+MetricsSnapshot metrics_snapshot() {
+    MetricsSnapshot snap;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const MetricsShard* s : r.shards) {
+        for (std::size_t p = 0; p < kMetricPhaseCount; ++p) {
+            LatencyHistogram& h = snap.phases[p];
+            for (std::size_t b = 0; b < LatencyHistogram::kBuckets; ++b) {
+                h.buckets[b] += s->buckets[p][b].load(std::memory_order_relaxed);
+            }
+            h.count += s->count[p].load(std::memory_order_relaxed);
+            h.sum_us += s->sum_us[p].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < 3; ++i) {
+            snap.status[i] += s->status[i].load(std::memory_order_relaxed);
+        }
+        for (int e = 0; e <= kMetricMaxErrno; ++e) {
+            snap.errors[e] += s->errors[e].load(std::memory_order_relaxed);
+        }
+        snap.ssl_errors += s->ssl_errors.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+std::string metrics_prometheus_text() {
+    MetricsSnapshot snap = metrics_snapshot();
+    std::string out;
+    out.reserve(8192);
+
+    out += "# HELP portscan_probe_results_total Probe results by port status.\n"
+           "# TYPE portscan_probe_results_total counter\n";
+    for (std::size_t i = 0; i < 3; ++i) {
+        append_metric(out, "portscan_probe_results_total{status=\"%s\"} %llu\n",
+                      kStatusNames[i], static_cast<unsigned long long>(snap.status[i]));
+    }
+
+    out += "# HELP portscan_socket_errors_total Socket-level failures by errno.\n"
+           "# TYPE portscan_socket_errors_total counter\n";
+    for (int e = 1; e <= kMetricMaxErrno; ++e) {
+        if (snap.errors[e]) {
+            append_metric(out, "portscan_socket_errors_total{errno=\"%s\"} %llu\n",
+                          errno_label(e).c_str(), static_cast<unsigned long long>(snap.errors[e]));
+        }
+    }
+
+    out += "# HELP portscan_ssl_errors_total OpenSSL errors logged.\n"
+           "# TYPE portscan_ssl_errors_total counter\n";
+    append_metric(out, "portscan_ssl_errors_total %llu\n", static_cast<unsigned long long>(snap.ssl_errors));
+
+    // Bucket edges every 4x from 16 us to ~268 s. Each power of two starts
+    // a histogram bucket, so le is published as edge - 1 us: the upper bound
+    // of the last bucket counted, which keeps the cumulative counts exact.
+    out += "# HELP portscan_phase_duration_seconds Time spent in each probe phase.\n"
+           "# TYPE portscan_phase_duration_seconds histogram\n";
+    for (std::size_t p = 0; p < kMetricPhaseCount; ++p) {
+        const LatencyHistogram& h = snap.phases[p];
+        uint64_t cumulative = 0;
+        std::size_t b = 0;
+        for (unsigned shift = 4; shift <= 28; shift += 2) {
+            uint64_t edge = 1ull << shift;
+            while (b < LatencyHistogram::kBuckets && LatencyHistogram::bucket_upper(b) < edge) {
+                cumulative += h.buckets[b++];
+            }
+            append_metric(out, "portscan_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.6f\"} %llu\n",
+                          kPhaseNames[p], static_cast<double>(edge - 1) / 1e6,
+                          static_cast<unsigned long long>(cumulative));
+        }
+        append_metric(out, "portscan_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+                      kPhaseNames[p], static_cast<unsigned long long>(h.count));
+        append_metric(out, "portscan_phase_duration_seconds_sum{phase=\"%s\"} %.6f\n",
+                      kPhaseNames[p], static_cast<double>(h.sum_us) / 1e6);
+        append_metric(out, "portscan_phase_duration_seconds_count{phase=\"%s\"} %llu\n",
+                      kPhaseNames[p], static_cast<unsigned long long>(h.count));
+    }
+
+    out += "# HELP portscan_phase_duration_quantile_seconds Latency quantiles per phase (within 6.25%).\n"
+           "# TYPE portscan_phase_duration_quantile_seconds gauge\n";
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (std::size_t p = 0; p < kMetricPhaseCount; ++p) {
+        for (double q : kQuantiles) {
+            append_metric(out, "portscan_phase_duration_quantile_seconds{phase=\"%s\",quantile=\"%g\"} %.6f\n",
+                          kPhaseNames[p], q, static_cast<double>(snap.phases[p].quantile(q)) / 1e6);
+        }
+    }
+    return out;
+}
+
+bool write_metrics_file(const std::string& path) {
+    const std::string text = metrics_prometheus_text();
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "w");
+    if (!f) {
+        std::cerr << "Error: cannot open metrics file '" << tmp << "' - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (std::fclose(f) != 0) ok = false;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: failed to write metrics file '" << path << "' - " << std::strerror(errno) << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+MetricsHttpServer::MetricsHttpServer() : listen_fd_(-1), wake_fd_(-1) {}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start(int port) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd_ < 0 || wake_fd_ < 0) {
+        std::cerr << "Error: metrics endpoint setup failed - " << std::strerror(errno) << "\n";
+        stop();
+        return false;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, 16) < 0) {
+        std::cerr << "Error: cannot listen for metrics on 127.0.0.1:" << port << " - "
+                  << std::strerror(errno) << "\n";
+        stop();
+        return false;
+    }
+    server_ = std::thread(&MetricsHttpServer::serve_main, this);
+    return true;
+}
+
+void MetricsHttpServer::stop() {
+    if (server_.joinable()) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "Error: eventfd write failed - " << std::strerror(errno) << "\n";
+        }
+        server_.join();
+    }
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    listen_fd_ = wake_fd_ = -1;
+}
+
+/**
+ * @brief Answers one request per connection; scrapes are rare, so serially is enough.
+ */
+void MetricsHttpServer::serve_main() {
+    for (;;) {
+        struct pollfd pfds[2] = {{listen_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (pfds[1].revents) {
+            return;
+        }
+        int conn = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            continue;
+        }
+
+        // Read the request head, giving a slow client at most one second.
+        char req[2048];
+        std::size_t len = 0;
+        while (len < sizeof(req) - 1) {
+            struct pollfd cp = {conn, POLLIN, 0};
+            if (poll(&cp, 1, 1000) <= 0) break;
+            ssize_t n = recv(conn, req + len, sizeof(req) - 1 - len, 0);
+            if (n <= 0) break;
+            len += static_cast<std::size_t>(n);
+            req[len] = '\0';
+            if (std::strstr(req, "\r\n\r\n")) break;
+        }
+        req[len] = '\0';
+
+        std::string body, status;
+        if (std::strncmp(req, "GET /metrics ", 13) == 0 || std::strncmp(req, "GET / ", 6) == 0) {
+            status = "200 OK";
+            body = metrics_prometheus_text();
+        } else {
+            status = "404 Not Found";
+            body = "not found\n";
+        }
+        std::string resp = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+        std::size_t off = 0;
+        while (off < resp.size()) {
+            ssize_t n = send(conn, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            off += static_cast<std::size_t>(n);
+        }
+        close(conn);
+    }
+}
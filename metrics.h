@@ -0,0 +1,153 @@
+#pragma once
+#include "scanner.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <time.h>
+
+/**
+ * @brief Timed phases of a probe or handshake.
+ */
+enum class MetricPhase {
+    DNS_RESOLVE,    ///< getaddrinfo() on a resolver cache miss.
+    SOCKET_CREATE,  ///< socket() for a probe or handshake.
+    CONNECT,        ///< connect() to OPEN / CLOSED / FILTERED.
+    TLS_HANDSHAKE,  ///< First SSL_do_handshake() call to completion.
+    CERT_PARSE,     ///< Extracting CertInfo from the peer certificate.
+};
+
+/// Number of MetricPhase values.
+const std::size_t kMetricPhaseCount = 5;
+
+/// errno values above this are counted together in the last slot.
+const int kMetricMaxErrno = 134;
+
+/**
+ * @brief Returns the current CLOCK_MONOTONIC time in microseconds.
+ */
+inline uint64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000u + static_cast<uint64_t>(ts.tv_nsec) / 1000u;
+}
+
+/**
+ * @brief Log-linear latency histogram in microseconds (HDR style).
+ *
+ * Values below 16 us get exact buckets; above that every power of two is
+ * split into 16 sub-buckets, so any recorded value is reported within 6.25%
+ * across the whole range (up to ~12 days) in a fixed 4.8 KiB table.
+ */
+struct LatencyHistogram {
+    static const std::size_t kSubBuckets = 16;
+    static const std::size_t kBuckets = kSubBuckets + 37 * kSubBuckets;
+
+    uint64_t buckets[kBuckets] = {};
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+
+    /** @brief Bucket index for a value. */
+    static std::size_t bucket_of(uint64_t us);
+
+    /** @brief Largest value that falls into a bucket. */
+    static uint64_t bucket_upper(std::size_t bucket);
+
+    /**
+     * @brief Value below which a fraction q of samples fall.
+     * @param q Quantile in [0, 1].
+     * @return Upper edge of the bucket holding the quantile, or 0 if empty.
+     */
+    uint64_t quantile(double q) const;
+};
+
+/**
+ * @brief Point-in-time sum of every thread's counters.
+ */
+struct MetricsSnapshot {
+    LatencyHistogram phases[kMetricPhaseCount];
+    uint64_t status[3] = {};                   ///< Indexed by PortStatus.
+    uint64_t errors[kMetricMaxErrno + 1] = {}; ///< Indexed by errno.
+    uint64_t ssl_errors = 0;                   ///< OpenSSL error-queue entries.
+};
+
+/**
+ * @brief Records one latency sample for a phase on the calling thread's shard.
+ *
+ * Each thread writes only its own counters (relaxed atomic adds on memory no
+ * other thread writes), so recording never contends or blocks.
+ */
+void metrics_record(MetricPhase phase, uint64_t us);
+
+/** @brief Counts a probe result. */
+void metrics_count_status(PortStatus status);
+
+/** @brief Counts a socket-level failure by errno. */
+void metrics_count_errno(int err);
+
+/** @brief Counts OpenSSL errors reported through log_ssl_errors(). */
+void metrics_count_ssl_errors(uint64_t n);
+
+/**
+ * @brief Sums every thread's counters, including threads that have exited.
+ */
+MetricsSnapshot metrics_snapshot();
+
+/**
+ * @brief Renders the current metrics in Prometheus text exposition format.
+ */
+std::string metrics_prometheus_text();
+
+/**
+ * @brief Writes metrics_prometheus_text() to a file, replacing it atomically
+ *        (suitable for node_exporter's textfile collector).
+ * @param path Output file.
+ * @return false on I/O error (an error is printed).
+ */
+bool write_metrics_file(const std::string& path);
+
+/**
+ * @brief Records the time from construction to destruction as one sample.
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(MetricPhase phase) : phase_(phase), start_(monotonic_us()) {}
+    ~PhaseTimer() { metrics_record(phase_, monotonic_us() - start_); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    MetricPhase phase_;
+    uint64_t start_;
+};
+
+/**
+ * @brief Serves GET /metrics on a local TCP port from a background thread.
+ */
+class MetricsHttpServer {
+public:
+    MetricsHttpServer();
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    /**
+     * @brief Binds 127.0.0.1:port and starts serving.
+     * @param port TCP port to listen on.
+     * @return false if the port cannot be bound (an error is printed).
+     */
+    bool start(int port);
+
+    /** @brief Stops the server thread and closes the socket. */
+    void stop();
+
+private:
+    void serve_main();
+
+    int listen_fd_;
+    int wake_fd_;
+    std::thread server_;
+};
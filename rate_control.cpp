@@ -0,0 +1,100 @@
+#include "rate_control.h"
+#include <cmath>
+
+void RttEstimator::sample(uint32_t rtt_ms) {
+    double r = static_cast<double>(rtt_ms);
+    if (samples_ == 0) {
+        srtt_ms_ = r;
+        rttvar_ms_ = r / 2.0;
+    } else {
+        rttvar_ms_ = 0.75 * rttvar_ms_ + 0.25 * std::fabs(srtt_ms_ - r);
+        srtt_ms_ = 0.875 * srtt_ms_ + 0.125 * r;
+    }
+    ++samples_;
+}
+
+uint32_t RttEstimator::timeout_ms(uint32_t initial_ms, uint32_t min_ms, uint32_t max_ms) const {
+    if (samples_ == 0) {
+        return initial_ms;
+    }
+    double rto = srtt_ms_ + 4.0 * rttvar_ms_;
+    if (rto < min_ms) return min_ms;
+    if (rto > max_ms) return max_ms;
+    return static_cast<uint32_t>(rto);
+}
+
+TokenBucket::TokenBucket(double rate_per_sec, double burst)
+    : rate_(rate_per_sec > 0.0 ? rate_per_sec : 0.0),
+      burst_(burst > 1.0 ? burst : 1.0),
+      tokens_(burst > 1.0 ? burst : 1.0),
+      last_ms_(0) {}
+
+void TokenBucket::refill(uint64_t now_ms) {
+    if (last_ms_ == 0) {
+        last_ms_ = now_ms;
+        return;
+    }
+    if (now_ms > last_ms_) {
+        tokens_ += rate_ * static_cast<double>(now_ms - last_ms_) / 1000.0;
+        if (tokens_ > burst_) tokens_ = burst_;
+        last_ms_ = now_ms;
+    }
+}
+
+bool TokenBucket::try_acquire(uint64_t now_ms) {
+    if (rate_ <= 0.0) {
+        return true;
+    }
+    refill(now_ms);
+    if (tokens_ >= 1.0) {
+        tokens_ -= 1.0;
+        return true;
+    }
+    return false;
+}
+
+void TokenBucket::refund() {
+    if (rate_ > 0.0 && tokens_ + 1.0 <= burst_) {
+        tokens_ += 1.0;
+    }
+}
+
+uint32_t TokenBucket::wait_ms(uint64_t now_ms) {
+    if (rate_ <= 0.0) {
+        return 0;
+    }
+    refill(now_ms);
+    if (tokens_ >= 1.0) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::ceil((1.0 - tokens_) * 1000.0 / rate_));
+}
+
+CongestionWindow::CongestionWindow(std::size_t initial, std::size_t min_window, std::size_t max_window)
+    : cwnd_(static_cast<double>(initial)),
+      ssthresh_(static_cast<double>(max_window)),
+      min_(static_cast<double>(min_window ? min_window : 1)),
+      max_(static_cast<double>(max_window ? max_window : 1)),
+      last_decrease_ms_(0) {
+    if (cwnd_ < min_) cwnd_ = min_;
+    if (cwnd_ > max_) cwnd_ = max_;
+}
+
+void CongestionWindow::on_response() {
+    if (cwnd_ < ssthresh_) {
+        cwnd_ += 1.0;
+    } else {
+        cwnd_ += 1.0 / cwnd_;
+    }
+    if (cwnd_ > max_) cwnd_ = max_;
+}
+
+void CongestionWindow::on_loss(uint64_t now_ms, uint32_t holdoff_ms) {
+    if (last_decrease_ms_ != 0 && now_ms - last_decrease_ms_ < holdoff_ms) {
+        return;
+    }
+    last_decrease_ms_ = now_ms;
+    cwnd_ *= 0.75;
+    if (cwnd_ < min_) cwnd_ = min_;
+    ssthresh_ = cwnd_;
+}
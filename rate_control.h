@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Per-target round-trip estimator (RFC 6298 style).
+ *
+ * Keeps a smoothed RTT and RTT variance from connect() round trips and turns
+ * them into the deadline after which a silent port is reported FILTERED.
+ */
+class RttEstimator {
+public:
+    RttEstimator() : srtt_ms_(0.0), rttvar_ms_(0.0), samples_(0) {}
+
+    /**
+     * @brief Feeds one measured round trip.
+     * @param rtt_ms Time from connect() to SYN-ACK or RST.
+     */
+    void sample(uint32_t rtt_ms);
+
+    /**
+     * @brief Deadline for the next probe to this target.
+     * @param initial_ms Deadline used before any sample exists.
+     * @param min_ms Lower clamp.
+     * @param max_ms Upper clamp.
+     * @return srtt + 4 * rttvar, clamped to [min_ms, max_ms].
+     */
+    uint32_t timeout_ms(uint32_t initial_ms, uint32_t min_ms, uint32_t max_ms) const;
+
+    /** @brief Number of samples taken so far. */
+    uint32_t samples() const { return samples_; }
+
+    /** @brief Smoothed RTT in milliseconds (0 before the first sample). */
+    double srtt_ms() const { return srtt_ms_; }
+
+private:
+    double srtt_ms_;
+    double rttvar_ms_;
+    uint32_t samples_;
+};
+
+/**
+ * @brief Token-bucket limiter for probe launches.
+ *
+ * A rate of 0 disables limiting. Tokens accrue continuously up to burst.
+ */
+class TokenBucket {
+public:
+    /**
+     * @param rate_per_sec Sustained probes per second; 0 means unlimited.
+     * @param burst Maximum tokens that can accumulate.
+     */
+    explicit TokenBucket(double rate_per_sec = 0.0, double burst = 0.0);
+
+    /**
+     * @brief Consumes one token if available.
+     * @param now_ms Current monotonic time.
+     * @return true if a probe may be launched now.
+     */
+    bool try_acquire(uint64_t now_ms);
+
+    /** @brief Returns a token taken by try_acquire() for a probe that was never sent. */
+    void refund();
+
+    /**
+     * @brief Milliseconds until the next token is available (0 if one is ready or unlimited).
+     * @param now_ms Current monotonic time.
+     */
+    uint32_t wait_ms(uint64_t now_ms);
+
+    /** @brief True if a rate limit is configured. */
+    bool limited() const { return rate_ > 0.0; }
+
+private:
+    void refill(uint64_t now_ms);
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    uint64_t last_ms_;
+};
+
+/**
+ * @brief AIMD congestion window over the number of probes in flight.
+ *
+ * Grows by one probe per response (slow start) until the first loss, then by
+ * roughly one probe per window of responses. Losses shrink the window by a
+ * quarter, at most once per hold-off interval so a burst of timeouts from one
+ * event is counted once.
+ */
+class CongestionWindow {
+public:
+    /**
+     * @param initial Starting window.
+     * @param min_window Floor after decreases.
+     * @param max_window Ceiling (the engine's slot count).
+     */
+    CongestionWindow(std::size_t initial, std::size_t min_window, std::size_t max_window);
+
+    /** @brief Current window in probes. */
+    std::size_t size() const { return static_cast<std::size_t>(cwnd_); }
+
+    /** @brief Records a probe that drew a response. */
+    void on_response();
+
+    /**
+     * @brief Records a probe that was lost (timed out against a responsive target,
+     *        or failed on local resource exhaustion).
+     * @param now_ms Current monotonic time.
+     * @param holdoff_ms Minimum spacing between two decreases.
+     */
+    void on_loss(uint64_t now_ms, uint32_t holdoff_ms);
+
+private:
+    double cwnd_;
+    double ssthresh_;
+    double min_;
+    double max_;
+    uint64_t last_decrease_ms_;
+};
@@ -0,0 +1,188 @@
+#include "resolver.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+socklen_t TargetAddress::to_sockaddr(int port, sockaddr_storage& out) const {
+    std::memset(&out, 0, sizeof(out));
+    if (family == AF_INET6) {
+        sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(&out);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(static_cast<uint16_t>(port));
+        sin6->sin6_scope_id = scope_id;
+        std::memcpy(&sin6->sin6_addr, bytes, 16);
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&out);
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(static_cast<uint16_t>(port));
+    std::memcpy(&sin->sin_addr, bytes, 4);
+    return sizeof(sockaddr_in);
+}
+
+std::string TargetAddress::to_string() const {
+    char buf[INET6_ADDRSTRLEN];
+    if (!inet_ntop(family == AF_INET6 ? AF_INET6 : AF_INET, bytes, buf, sizeof(buf))) {
+        return "";
+    }
+    return buf;
+}
+
+TargetCache::TargetCache(uint32_t ttl_sec, uint32_t negative_ttl_sec)
+    : ttl_ms_(ttl_sec * 1000u), negative_ttl_ms_(negative_ttl_sec * 1000u), dead_(0) {}
+
+/**
+ * @brief Looks up a cached entry, resolving with getaddrinfo() when missing or expired.
+ *
+ * The lock is released around getaddrinfo(); concurrent callers for the same
+ * name wait for that one resolution instead of starting their own.
+ *
+ * @param host Hostname or numeric address.
+ * @param lock Holds mutex_ on entry and on return.
+ * @return Pointer to the entry; valid while mutex_ is held.
+ */
+const TargetCache::Entry* TargetCache::find_or_resolve(const std::string& host, std::unique_lock<std::mutex>& lock) {
+    for (;;) {
+        auto it = entries_.find(host);
+        if (it != entries_.end() && it->second.expires_ms > monotonic_ms()) {
+            return &it->second;
+        }
+        if (resolving_.insert(host).second) {
+            break;
+        }
+        resolved_.wait(lock);
+    }
+    lock.unlock();
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    uint64_t resolve_start = monotonic_us();
+    int rc = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    metrics_record(MetricPhase::DNS_RESOLVE, monotonic_us() - resolve_start);
+
+    std::vector<TargetAddress> v4, v6;
+    if (rc == 0) {
+        for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+            TargetAddress a;
+            a.family = static_cast<sa_family_t>(ai->ai_family);
+            if (ai->ai_family == AF_INET) {
+                std::memcpy(a.bytes, &reinterpret_cast<sockaddr_in*>(ai->ai_addr)->sin_addr, 4);
+                v4.push_back(a);
+            } else if (ai->ai_family == AF_INET6) {
+                const sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(ai->ai_addr);
+                std::memcpy(a.bytes, &sin6->sin6_addr, 16);
+                a.scope_id = sin6->sin6_scope_id;
+                v6.push_back(a);
+            }
+        }
+        freeaddrinfo(res);
+    } else {
+        std::cerr << "Error: could not resolve host '" << host << "' - "
+                  << gai_strerror(rc) << "\n";
+    }
+    v4.insert(v4.end(), v6.begin(), v6.end());
+
+    lock.lock();
+    publish(host, v4, monotonic_ms() + (v4.empty() ? negative_ttl_ms_ : ttl_ms_));
+    resolving_.erase(host);
+    resolved_.notify_all();
+    return &entries_[host];
+}
+
+/**
+ * @brief Stores a resolution, reusing the entry's old slots when they are big enough.
+ *
+ * Called with mutex_ held.
+ */
+void TargetCache::publish(const std::string& host, const std::vector<TargetAddress>& addrs, uint64_t expires_ms) {
+    const uint32_t count = static_cast<uint32_t>(addrs.size());
+    auto it = entries_.find(host);
+    Entry entry;
+    if (it != entries_.end()) {
+        entry.rtt = it->second.rtt;
+    }
+    entry.count = count;
+    entry.expires_ms = expires_ms;
+    if (it != entries_.end() && count <= it->second.capacity) {
+        entry.first = it->second.first;
+        entry.capacity = it->second.capacity;
+    } else {
+        if (it != entries_.end()) {
+            dead_ += it->second.capacity;
+        }
+        entry.first = static_cast<uint32_t>(addrs_.size());
+        entry.capacity = count;
+        addrs_.resize(addrs_.size() + count);
+    }
+    std::copy(addrs.begin(), addrs.end(), addrs_.begin() + entry.first);
+    entries_[host] = entry;
+    if (dead_ > addrs_.size() / 2) {
+        compact();
+    }
+}
+
+/**
+ * @brief Rewrites addrs_ without the slots abandoned by grown entries.
+ */
+void TargetCache::compact() {
+    std::vector<TargetAddress> addrs;
+    addrs.reserve(addrs_.size() - dead_);
+    for (auto& kv : entries_) {
+        Entry& e = kv.second;
+        uint32_t first = static_cast<uint32_t>(addrs.size());
+        addrs.insert(addrs.end(), addrs_.begin() + e.first, addrs_.begin() + e.first + e.capacity);
+        e.first = first;
+    }
+    addrs_.swap(addrs);
+    dead_ = 0;
+}
+
+bool TargetCache::lookup(const std::string& host, TargetAddress& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const Entry* e = find_or_resolve(host, lock);
+    if (e->count == 0) {
+        return false;
+    }
+    out = addrs_[e->first];
+    return true;
+}
+
+bool TargetCache::lookup_all(const std::string& host, std::vector<TargetAddress>& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const Entry* e = find_or_resolve(host, lock);
+    out.assign(addrs_.begin() + e->first, addrs_.begin() + e->first + e->count);
+    return e->count != 0;
+}
+
+RttEstimator TargetCache::rtt(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(host);
+    return it == entries_.end() ? RttEstimator() : it->second.rtt;
+}
+
+void TargetCache::record_rtt(const std::string& host, const RttEstimator& rtt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(host);
+    if (it != entries_.end()) {
+        it->second.rtt = rtt;
+    }
+}
+
+void TargetCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    addrs_.clear();
+    dead_ = 0;
+}
+
+TargetCache& default_target_cache() {
+    static TargetCache cache;
+    return cache;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "rate_control.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief A resolved IPv4 or IPv6 address without a port.
+ *
+ * Kept deliberately small so that a target table for a large range stays
+ * compact; a full sockaddr is only materialised per probe.
+ */
+struct TargetAddress {
+    sa_family_t family = AF_UNSPEC;  ///< AF_INET or AF_INET6.
+    uint32_t scope_id = 0;           ///< IPv6 scope (link-local addresses).
+    uint8_t bytes[16] = {};          ///< Address in network byte order (4 bytes used for IPv4).
+
+    /**
+     * @brief Builds a socket address for this target.
+     * @param port TCP port to place in the address.
+     * @param out Output socket address.
+     * @return Length of the populated address.
+     */
+    socklen_t to_sockaddr(int port, sockaddr_storage& out) const;
+
+    /** @brief Numeric representation, e.g. "127.0.0.1" or "::1". */
+    std::string to_string() const;
+};
+
+/**
+ * @brief Resolve-once cache of hostnames to addresses.
+ *
+ * Each host is resolved with getaddrinfo() on first use and the result is kept
+ * for ttl_sec seconds. Failed lookups are cached for negative_ttl_sec so that a
+ * bad name in a large job is reported once instead of once per port.
+ * IPv4 addresses are ordered before IPv6 so that dual-stack names such as
+ * "localhost" keep the scanner's historical IPv4 behaviour. Thread-safe:
+ * getaddrinfo() runs without the cache lock, so one slow name only delays
+ * callers asking for that same name.
+ */
+class TargetCache {
+public:
+    explicit TargetCache(uint32_t ttl_sec = 300, uint32_t negative_ttl_sec = 30);
+
+    /**
+     * @brief Returns the preferred address for host, resolving it if needed.
+     * @param host Hostname or numeric address.
+     * @param out Output address.
+     * @return false if the name cannot be resolved (an error is printed once per TTL).
+     */
+    bool lookup(const std::string& host, TargetAddress& out);
+
+    /**
+     * @brief Returns every address for host, resolving it if needed.
+     * @param host Hostname or numeric address.
+     * @param out Output addresses, IPv4 first.
+     * @return false if the name cannot be resolved.
+     */
+    bool lookup_all(const std::string& host, std::vector<TargetAddress>& out);
+
+    /**
+     * @brief RTT estimate kept for host by earlier probes.
+     *
+     * One-shot wrappers such as scan_port() seed their engine with this and
+     * hand the result back through record_rtt(), so adaptive deadlines work
+     * across calls and not only within one batch.
+     *
+     * @return The stored estimate, or a fresh one if host has none.
+     */
+    RttEstimator rtt(const std::string& host);
+
+    /**
+     * @brief Stores host's RTT estimate after a probe; ignored for unknown hosts.
+     */
+    void record_rtt(const std::string& host, const RttEstimator& rtt);
+
+    /** @brief Drops every cached entry. */
+    void clear();
+
+private:
+    struct Entry {
+        uint32_t first;     ///< Index of the first address in addrs_.
+        uint32_t count;     ///< Number of addresses; 0 for a cached failure.
+        uint32_t capacity;  ///< Slots reserved at first; re-resolutions up to this size reuse them.
+        uint64_t expires_ms;
+        RttEstimator rtt;   ///< Survives re-resolution; see rtt().
+    };
+
+    const Entry* find_or_resolve(const std::string& host, std::unique_lock<std::mutex>& lock);
+    void publish(const std::string& host, const std::vector<TargetAddress>& addrs, uint64_t expires_ms);
+    void compact();
+
+    uint32_t ttl_ms_;
+    uint32_t negative_ttl_ms_;
+    std::mutex mutex_;
+    std::condition_variable resolved_;               ///< Signalled when a name in resolving_ is published.
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_set<std::string> resolving_;      ///< Names with a getaddrinfo() in progress.
+    std::vector<TargetAddress> addrs_;
+    std::size_t dead_;                               ///< Slots in addrs_ no entry refers to any more.
+};
+
+/**
+ * @brief Process-wide cache shared by scan_port() and get_cert_info().
+ */
+TargetCache& default_target_cache();
@@ -0,0 +1,499 @@
+#include "result_sink.h"
+#include "scan_record.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+BufferedWriter::BufferedWriter(int fd, bool owns_fd, bool async, std::size_t buffer_size)
+    : fd_(fd),
+      memory_(nullptr),
+      owns_fd_(owns_fd),
+      async_(async),
+      capacity_(buffer_size ? buffer_size : 1),
+      has_pending_(false),
+      writing_(false),
+      stop_(false) {
+    active_.reserve(capacity_);
+    if (async_) {
+        writer_ = std::thread(&BufferedWriter::writer_main, this);
+    }
+}
+
+BufferedWriter::BufferedWriter(std::vector<char>& out)
+    : fd_(-1),
+      memory_(&out),
+      owns_fd_(false),
+      async_(false),
+      capacity_(1 << 16),
+      has_pending_(false),
+      writing_(false),
+      stop_(false) {
+    active_.reserve(capacity_);
+}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+    if (async_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_.join();
+    }
+    if (owns_fd_ && fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void BufferedWriter::write(const void* data, std::size_t len) {
+    const char* p = static_cast<const char*>(data);
+    active_.insert(active_.end(), p, p + len);
+    if (active_.size() >= capacity_) {
+        hand_off();
+    }
+}
+
+/**
+ * @brief Writes a whole buffer, retrying on short writes and EINTR; in
+ *        memory mode, appends it to the destination vector.
+ */
+void BufferedWriter::write_all(const std::vector<char>& buf) {
+    if (memory_) {
+        memory_->insert(memory_->end(), buf.begin(), buf.end());
+        return;
+    }
+    std::size_t off = 0;
+    while (off < buf.size()) {
+        ssize_t n = ::write(fd_, buf.data() + off, buf.size() - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: write() failed - " << std::strerror(errno) << "\n";
+            return;
+        }
+        off += static_cast<std::size_t>(n);
+    }
+}
+
+/**
+ * @brief Moves the active buffer to the fd (sync) or to the writer thread (async).
+ */
+void BufferedWriter::hand_off() {
+    if (active_.empty()) {
+        return;
+    }
+    if (!async_) {
+        write_all(active_);
+        active_.clear();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return !has_pending_; });
+    pending_.swap(active_);
+    has_pending_ = true;
+    lock.unlock();
+    cv_.notify_all();
+    active_.clear();
+    active_.reserve(capacity_);
+}
+
+void BufferedWriter::flush() {
+    hand_off();
+    if (async_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !has_pending_ && !writing_; });
+    }
+}
+
+/**
+ * @brief Background thread: writes each handed-off buffer, then recycles it.
+ */
+void BufferedWriter::writer_main() {
+    std::vector<char> buf;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this]() { return has_pending_ || stop_; });
+        if (!has_pending_) {
+            return;
+        }
+        buf.swap(pending_);
+        has_pending_ = false;
+        writing_ = true;
+        lock.unlock();
+        cv_.notify_all();
+
+        write_all(buf);
+        buf.clear();
+
+        lock.lock();
+        writing_ = false;
+        cv_.notify_all();
+    }
+}
+
+namespace {
+
+/**
+ * @brief Classic human-readable lines, identical to the historical std::cout output.
+ */
+class TextSink : public ResultSink {
+public:
+    explicit TextSink(std::unique_ptr<BufferedWriter> out) : out_(std::move(out)) {}
+
+    void port_result(const HostEntry& host, int port, const std::string& protocol, PortStatus status) override {
+        line_.clear();
+        line_ += "Host: ";
+        line_ += host.name;
+        line_ += " Port: ";
+        line_ += std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += " (" + protocol + ")";
+        }
+        line_ += " Status: ";
+        line_ += status_to_string(status);
+        line_ += '\n';
+        out_->write(line_);
+    }
+
+    void cert_result(const HostEntry& host, int port, const std::string& protocol, const CertInfo& cert) override {
+        line_.clear();
+        line_ += "Host: " + host.name + " Port: " + std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += " (" + protocol + ")";
+        }
+        line_ += " Cert valid: ";
+        line_ += cert.valid() ? "yes" : "no";
+        line_ += " Subject: " + cert.subject();
+        line_ += " Issuer: " + cert.issuer();
+        line_ += " Expiry: " + cert.not_after();
+        line_ += " Self-signed: ";
+        line_ += cert.self_signed() ? "yes" : "no";
+        line_ += '\n';
+        out_->write(line_);
+    }
+
+    void service_result(const HostEntry& host, int port, const std::string& protocol,
+                        PortStatus status, const std::string& service) override {
+        line_.clear();
+        line_ += "Host: " + host.name + " Port: " + std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += " (" + protocol + ")";
+        }
+        line_ += " Status: ";
+        line_ += status_to_string(status);
+        if (status == PortStatus::OPEN) {
+            line_ += " Service: ";
+            line_ += service.empty() ? "unconfirmed" : service;
+        }
+        line_ += '\n';
+        out_->write(line_);
+    }
+
+    void port_change(const HostEntry& host, int port, const std::string& protocol,
+                     PortState previous, PortStatus status) override {
+        line_.clear();
+        line_ += "Host: " + host.name + " Port: " + std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += " (" + protocol + ")";
+        }
+        line_ += " Status: ";
+        if (status == PortStatus::OPEN) {
+            line_ += "NEW: OPEN";
+        } else {
+            line_ += status_to_string(status) + " (was " + port_state_to_string(previous) + ")";
+        }
+        line_ += '\n';
+        out_->write(line_);
+    }
+
+    void cert_change(const HostEntry& host, int port, const std::string& protocol,
+                     const CertInfo& cert, const std::string& reason) override {
+        line_.clear();
+        line_ += "Host: " + host.name + " Port: " + std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += " (" + protocol + ")";
+        }
+        line_ += " Cert: " + reason;
+        if (cert.valid()) {
+            line_ += " Subject: " + cert.subject();
+            line_ += " Issuer: " + cert.issuer();
+            line_ += " Expiry: " + cert.not_after();
+        }
+        line_ += '\n';
+        out_->write(line_);
+    }
+
+    void note(const std::string& text) override {
+        out_->write(text + "\n");
+    }
+
+    void flush() override { out_->flush(); }
+
+private:
+    std::unique_ptr<BufferedWriter> out_;
+    std::string line_;
+};
+
+/**
+ * @brief Appends s to out as a JSON string literal.
+ */
+void append_json_string(std::string& out, const std::string& s) {
+    out += '"';
+    for (char ch : s) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += ch;
+                }
+        }
+    }
+    out += '"';
+}
+
+/**
+ * @brief One JSON object per line.
+ */
+class JsonLinesSink : public ResultSink {
+public:
+    explicit JsonLinesSink(std::unique_ptr<BufferedWriter> out) : out_(std::move(out)) {}
+
+    void port_result(const HostEntry& host, int port, const std::string& protocol, PortStatus status) override {
+        begin(host, port, protocol);
+        line_ += ",\"status\":\"";
+        line_ += status_to_string(status);
+        line_ += "\"}\n";
+        out_->write(line_);
+    }
+
+    void cert_result(const HostEntry& host, int port, const std::string& protocol, const CertInfo& cert) override {
+        begin(host, port, protocol);
+        line_ += ",\"cert_valid\":";
+        line_ += cert.valid() ? "true" : "false";
+        line_ += ",\"subject\":";
+        append_json_string(line_, cert.subject());
+        line_ += ",\"issuer\":";
+        append_json_string(line_, cert.issuer());
+        line_ += ",\"not_after\":";
+        append_json_string(line_, cert.not_after());
+        line_ += ",\"self_signed\":";
+        line_ += cert.self_signed() ? "true" : "false";
+        line_ += "}\n";
+        out_->write(line_);
+    }
+
+    void service_result(const HostEntry& host, int port, const std::string& protocol,
+                        PortStatus status, const std::string& service) override {
+        begin(host, port, protocol);
+        line_ += ",\"status\":\"";
+        line_ += status_to_string(status);
+        line_ += '"';
+        if (status == PortStatus::OPEN) {
+            line_ += ",\"service\":";
+            if (service.empty()) {
+                line_ += "null";
+            } else {
+                append_json_string(line_, service);
+            }
+        }
+        line_ += "}\n";
+        out_->write(line_);
+    }
+
+    void port_change(const HostEntry& host, int port, const std::string& protocol,
+                     PortState previous, PortStatus status) override {
+        begin(host, port, protocol);
+        line_ += ",\"status\":\"";
+        line_ += status_to_string(status);
+        line_ += "\",\"previous\":\"";
+        line_ += port_state_to_string(previous);
+        line_ += "\"}\n";
+        out_->write(line_);
+    }
+
+    void cert_change(const HostEntry& host, int port, const std::string& protocol,
+                     const CertInfo& cert, const std::string& reason) override {
+        begin(host, port, protocol);
+        line_ += ",\"cert_change\":";
+        append_json_string(line_, reason);
+        if (cert.valid()) {
+            line_ += ",\"subject\":";
+            append_json_string(line_, cert.subject());
+            line_ += ",\"issuer\":";
+            append_json_string(line_, cert.issuer());
+            line_ += ",\"not_after\":";
+            append_json_string(line_, cert.not_after());
+        }
+        line_ += "}\n";
+        out_->write(line_);
+    }
+
+    void note(const std::string& text) override {
+        line_.clear();
+        line_ += "{\"note\":";
+        append_json_string(line_, text);
+        line_ += "}\n";
+        out_->write(line_);
+    }
+
+    void flush() override { out_->flush(); }
+
+private:
+    void begin(const HostEntry& host, int port, const std::string& protocol) {
+        line_.clear();
+        line_ += "{\"host\":";
+        append_json_string(line_, host.name);
+        line_ += ",\"addr\":";
+        append_json_string(line_, host.addr.family == AF_UNSPEC ? std::string() : host.addr.to_string());
+        line_ += ",\"port\":";
+        line_ += std::to_string(port);
+        if (!protocol.empty()) {
+            line_ += ",\"protocol\":";
+            append_json_string(line_, protocol);
+        }
+    }
+
+    std::unique_ptr<BufferedWriter> out_;
+    std::string line_;
+};
+
+/**
+ * @brief Fixed-size records as described in scan_record.h.
+ */
+class BinarySink : public ResultSink {
+public:
+    explicit BinarySink(std::unique_ptr<BufferedWriter> out) : out_(std::move(out)) {
+        BinaryHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+        header.version = kBinaryVersion;
+        header.endian = kBinaryEndianMark;
+        header.record_size = sizeof(BinaryRecord);
+        out_->write(&header, sizeof(header));
+    }
+
+    void port_result(const HostEntry& host, int port, const std::string&, PortStatus status) override {
+        BinaryRecord rec = make_record(host, port);
+        rec.status = static_cast<uint8_t>(status);
+        out_->write(&rec, sizeof(rec));
+    }
+
+    void cert_result(const HostEntry& host, int port, const std::string&, const CertInfo& cert) override {
+        BinaryRecord rec = make_record(host, port);
+        rec.status = static_cast<uint8_t>(cert.valid() ? PortStatus::OPEN : PortStatus::CLOSED);
+        rec.flags = kRecordHasCert;
+        if (cert.valid()) rec.flags |= kRecordCertValid;
+        if (cert.self_signed()) rec.flags |= kRecordSelfSigned;
+        out_->write(&rec, sizeof(rec));
+    }
+
+    void service_result(const HostEntry& host, int port, const std::string&,
+                        PortStatus status, const std::string& service) override {
+        BinaryRecord rec = make_record(host, port);
+        rec.status = static_cast<uint8_t>(status);
+        if (!service.empty()) rec.flags = kRecordServiceConfirmed;
+        out_->write(&rec, sizeof(rec));
+    }
+
+    void port_change(const HostEntry& host, int port, const std::string&,
+                     PortState previous, PortStatus status) override {
+        BinaryRecord rec = make_record(host, port);
+        rec.status = static_cast<uint8_t>(status);
+        rec.flags = kRecordChanged;
+        rec.reserved[0] = static_cast<uint8_t>(previous);
+        out_->write(&rec, sizeof(rec));
+    }
+
+    void cert_change(const HostEntry& host, int port, const std::string&,
+                     const CertInfo& cert, const std::string&) override {
+        BinaryRecord rec = make_record(host, port);
+        rec.status = static_cast<uint8_t>(cert.valid() ? PortStatus::OPEN : PortStatus::CLOSED);
+        rec.flags = kRecordHasCert | kRecordChanged;
+        if (cert.valid()) rec.flags |= kRecordCertValid;
+        if (cert.self_signed()) rec.flags |= kRecordSelfSigned;
+        rec.reserved[0] = static_cast<uint8_t>(PortState::OPEN);
+        out_->write(&rec, sizeof(rec));
+    }
+
+    void note(const std::string&) override {}
+
+    void flush() override { out_->flush(); }
+
+private:
+    static BinaryRecord make_record(const HostEntry& host, int port) {
+        BinaryRecord rec;
+        std::memset(&rec, 0, sizeof(rec));
+        if (host.addr.family == AF_INET) {
+            rec.family = 4;
+            std::memcpy(rec.addr, host.addr.bytes, 4);
+        } else if (host.addr.family == AF_INET6) {
+            rec.family = 6;
+            std::memcpy(rec.addr, host.addr.bytes, 16);
+        }
+        rec.port = static_cast<uint16_t>(port);
+        return rec;
+    }
+
+    std::unique_ptr<BufferedWriter> out_;
+};
+
+/**
+ * @brief Wraps a writer in the sink for format, which must already be validated.
+ */
+std::unique_ptr<ResultSink> sink_for_format(const std::string& format, std::unique_ptr<BufferedWriter> out) {
+    if (format == "jsonl") {
+        return std::unique_ptr<ResultSink>(new JsonLinesSink(std::move(out)));
+    }
+    if (format == "binary") {
+        return std::unique_ptr<ResultSink>(new BinarySink(std::move(out)));
+    }
+    return std::unique_ptr<ResultSink>(new TextSink(std::move(out)));
+}
+
+bool known_format(const std::string& format) {
+    if (format != "text" && format != "jsonl" && format != "binary") {
+        std::cerr << "Error: unknown output format '" << format << "' (expected text, jsonl or binary).\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<ResultSink> make_result_sink(const std::string& format, const std::string& path, bool async) {
+    if (!known_format(format)) {
+        return nullptr;
+    }
+
+    int fd = STDOUT_FILENO;
+    bool owns_fd = false;
+    if (!path.empty() && path != "-") {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: cannot open output file '" << path << "' - " << std::strerror(errno) << "\n";
+            return nullptr;
+        }
+        owns_fd = true;
+    }
+    std::unique_ptr<BufferedWriter> out(new BufferedWriter(fd, owns_fd, async));
+    return sink_for_format(format, std::move(out));
+}
+
+std::unique_ptr<ResultSink> make_result_sink(const std::string& format, std::vector<char>& out) {
+    if (!known_format(format)) {
+        return nullptr;
+    }
+    return sink_for_format(format, std::unique_ptr<BufferedWriter>(new BufferedWriter(out)));
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "scanner.h"
+#include "cert_utils.h"
+#include "result_store.h"
+#include "target_spec.h"
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Batches output into large buffers and writes them to a file descriptor.
+ *
+ * In synchronous mode a full buffer is written inline. In asynchronous mode a
+ * background thread writes full buffers while the scanner keeps filling a
+ * second one, so slow terminals or pipes never stall the scan loop.
+ */
+class BufferedWriter {
+public:
+    /**
+     * @param fd Destination; closed on destruction if owns_fd is true.
+     * @param owns_fd Whether to close fd when done.
+     * @param async Use a background writer thread.
+     * @param buffer_size Bytes per buffer.
+     */
+    BufferedWriter(int fd, bool owns_fd, bool async, std::size_t buffer_size = 1 << 20);
+
+    /**
+     * @brief Collects output in memory instead of writing it to a descriptor.
+     * @param out Receives each buffer as it is handed off; must outlive the writer.
+     */
+    explicit BufferedWriter(std::vector<char>& out);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    /** @brief Appends bytes, handing the buffer off when it fills. */
+    void write(const void* data, std::size_t len);
+
+    /** @brief Appends a string. */
+    void write(const std::string& s) { write(s.data(), s.size()); }
+
+    /** @brief Writes everything buffered so far and waits for it to reach the fd. */
+    void flush();
+
+private:
+    void hand_off();
+    void write_all(const std::vector<char>& buf);
+    void writer_main();
+
+    int fd_;
+    std::vector<char>* memory_;  ///< Destination in memory mode, else nullptr.
+    bool owns_fd_;
+    bool async_;
+    std::size_t capacity_;
+    std::vector<char> active_;
+    // Asynchronous mode: one buffer may be queued for the writer thread.
+    std::vector<char> pending_;
+    bool has_pending_;
+    bool writing_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread writer_;
+};
+
+/**
+ * @brief Destination for scan results.
+ *
+ * Implementations format records into a BufferedWriter; nothing is flushed
+ * per record.
+ */
+class ResultSink {
+public:
+    virtual ~ResultSink() {}
+
+    /**
+     * @brief Records a TCP port result.
+     * @param host Target.
+     * @param port Port probed.
+     * @param protocol Configured protocol label (e.g. "SSH"), or empty.
+     * @param status Result.
+     */
+    virtual void port_result(const HostEntry& host, int port, const std::string& protocol, PortStatus status) = 0;
+
+    /**
+     * @brief Records a certificate retrieval result.
+     * @param host Target.
+     * @param port Port the handshake was attempted on.
+     * @param protocol Configured protocol label (e.g. "HTTPS").
+     * @param cert Certificate details.
+     */
+    virtual void cert_result(const HostEntry& host, int port, const std::string& protocol, const CertInfo& cert) = 0;
+
+    /**
+     * @brief Records a port result together with what the service identified itself as.
+     * @param host Target.
+     * @param port Port probed.
+     * @param protocol Configured protocol label (e.g. "SSH").
+     * @param status Result.
+     * @param service Identification (e.g. "SSH-2.0-OpenSSH_9.6"), or empty if the
+     *        service did not answer in the expected protocol.
+     */
+    virtual void service_result(const HostEntry& host, int port, const std::string& protocol,
+                                PortStatus status, const std::string& service) = 0;
+
+    /**
+     * @brief Records a port whose state differs from the previous run (diff mode).
+     * @param host Target.
+     * @param port Port probed.
+     * @param protocol Configured protocol label, or empty.
+     * @param previous State in the previous run.
+     * @param status Result of this run.
+     */
+    virtual void port_change(const HostEntry& host, int port, const std::string& protocol,
+                             PortState previous, PortStatus status) = 0;
+
+    /**
+     * @brief Records a certificate that changed or is about to expire (diff mode).
+     * @param host Target.
+     * @param port Port the handshake was made on.
+     * @param protocol Configured protocol label.
+     * @param cert Certificate retrieved in this run; invalid when reason is "MISSING".
+     * @param reason Short description, e.g. "CHANGED" or "EXPIRES IN 12 DAYS".
+     */
+    virtual void cert_change(const HostEntry& host, int port, const std::string& protocol,
+                             const CertInfo& cert, const std::string& reason) = 0;
+
+    /** @brief Records a free-form summary line such as "No changes detected". */
+    virtual void note(const std::string& text) = 0;
+
+    /** @brief Pushes buffered output to its destination. */
+    virtual void flush() = 0;
+};
+
+/**
+ * @brief Creates a sink.
+ * @param format "text" (the classic "Host: ... Port: ..." lines), "jsonl" or "binary" (see scan_record.h).
+ * @param path Output file, or "-" / empty for stdout.
+ * @param async Write through a background thread.
+ * @return The sink, or nullptr if the format is unknown or the file cannot be opened (an error is printed).
+ */
+std::unique_ptr<ResultSink> make_result_sink(const std::string& format, const std::string& path, bool async);
+
+/**
+ * @brief Creates a sink that renders into memory, e.g. a reply sent later without blocking.
+ * @param format As above.
+ * @param out Receives the output on flush(); must outlive the sink.
+ * @return The sink, or nullptr if the format is unknown (an error is printed).
+ */
+std::unique_ptr<ResultSink> make_result_sink(const std::string& format, std::vector<char>& out);
@@ -0,0 +1,671 @@
+#include "result_store.h"
+#include "scan_record.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+/// Words in a dense bitmap: 65536 ports x 2 bits.
+const std::size_t kDenseWords = 65536 * 2 / 64;
+/// A host switches to the dense form once its runs would take more space.
+const std::size_t kDenseRunLimit = kDenseWords * sizeof(uint64_t) / sizeof(PortRun);
+
+// On-disk layout written by ResultStore::save(). All integers are in host
+// byte order; the writer's endianness is recorded in the header.
+//
+//   StoreHeader | StoreHost[host_count] | StoreCert[cert_count]
+//   | bitmap data (8-byte aligned) | NUL-terminated strings
+//
+// Version 1 certificate entries stop before the fingerprint; they are still
+// read, with the fingerprint unknown.
+const char kStoreMagic[4] = {'P', 'S', 'R', 'S'};
+const uint16_t kStoreVersion = 2;
+const std::size_t kStoreCertV1Size = 20;
+
+struct StoreHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t endian;
+    uint32_t host_count;
+    uint32_t cert_count;
+    uint64_t hosts_offset;
+    uint64_t certs_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct StoreHost {
+    uint8_t addr[16];
+    uint32_t scope_id;
+    uint8_t family;       ///< 4, 6 or 0 as in BinaryRecord.
+    uint8_t dense;        ///< 1 if data is kDenseWords words, 0 if it is run_count runs.
+    uint16_t reserved;
+    uint32_t name;        ///< Offset into the string section.
+    uint32_t run_count;
+    uint64_t data_offset;
+};
+
+struct StoreCert {
+    uint32_t host;
+    uint16_t port;
+    uint8_t flags;        ///< kRecordCertValid / kRecordSelfSigned.
+    uint8_t reserved;
+    uint32_t subject;
+    uint32_t issuer;
+    uint32_t not_after;
+    uint8_t fingerprint[32];  ///< SHA-256 of the DER encoding; all zero if unknown (version 1).
+};
+
+static_assert(sizeof(StoreHeader) == 48, "StoreHeader layout changed");
+static_assert(sizeof(StoreHost) == 40, "StoreHost layout changed");
+static_assert(sizeof(StoreCert) == 52, "StoreCert layout changed");
+static_assert(sizeof(PortRun) == 8, "PortRun layout changed");
+
+PortRun make_run(uint16_t first, uint16_t last, uint8_t state) {
+    PortRun r;
+    std::memset(&r, 0, sizeof(r));
+    r.first = first;
+    r.last = last;
+    r.state = state;
+    return r;
+}
+
+inline uint8_t dense_get(const uint64_t* words, unsigned port) {
+    return static_cast<uint8_t>((words[port >> 5] >> ((port & 31) * 2)) & 3u);
+}
+
+inline void dense_set(uint64_t* words, unsigned port, uint8_t state) {
+    unsigned shift = (port & 31) * 2;
+    words[port >> 5] = (words[port >> 5] & ~(3ull << shift)) | (static_cast<uint64_t>(state) << shift);
+}
+
+/**
+ * @brief Rebuilds the run list for a dense bitmap.
+ */
+void runs_from_dense(const uint64_t* words, std::vector<PortRun>& runs) {
+    runs.clear();
+    for (unsigned port = 0; port < 65536; ++port) {
+        uint8_t s = dense_get(words, port);
+        if (s == 0) continue;
+        if (!runs.empty() && runs.back().last + 1u == port && runs.back().state == s) {
+            runs.back().last = static_cast<uint16_t>(port);
+        } else {
+            runs.push_back(make_run(static_cast<uint16_t>(port), static_cast<uint16_t>(port), s));
+        }
+    }
+}
+
+/**
+ * @brief Number of runs a dense bitmap would need, stopping once limit is exceeded.
+ */
+std::size_t dense_run_count(const uint64_t* words, std::size_t limit) {
+    std::size_t runs = 0;
+    uint8_t prev = 0;
+    for (unsigned port = 0; port < 65536 && runs <= limit; ++port) {
+        uint8_t s = dense_get(words, port);
+        if (s != 0 && s != prev) ++runs;
+        prev = s;
+    }
+    return runs;
+}
+
+/**
+ * @brief Appends s (with its terminator) to a string section and returns its offset.
+ */
+uint32_t add_string(std::string& strings, const std::string& s) {
+    uint32_t off = static_cast<uint32_t>(strings.size());
+    strings += s;
+    strings += '\0';
+    return off;
+}
+
+bool write_all(FILE* f, const void* data, std::size_t len) {
+    return len == 0 || std::fwrite(data, 1, len, f) == len;
+}
+
+} // namespace
+
+PortState to_port_state(PortStatus status) {
+    switch (status) {
+        case PortStatus::OPEN: return PortState::OPEN;
+        case PortStatus::CLOSED: return PortState::CLOSED;
+        case PortStatus::FILTERED: return PortState::FILTERED;
+    }
+    return PortState::NOT_SCANNED;
+}
+
+std::string port_state_to_string(PortState state) {
+    switch (state) {
+        case PortState::NOT_SCANNED: return "NOT_SCANNED";
+        case PortState::OPEN: return "OPEN";
+        case PortState::CLOSED: return "CLOSED";
+        case PortState::FILTERED: return "FILTERED";
+    }
+    return "UNKNOWN";
+}
+
+std::size_t HostSet::count() const {
+    std::size_t n = 0;
+    for (uint64_t w : words_) n += static_cast<std::size_t>(__builtin_popcountll(w));
+    return n;
+}
+
+std::vector<std::size_t> HostSet::to_vector() const {
+    std::vector<std::size_t> out;
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+        uint64_t w = words_[i];
+        while (w) {
+            out.push_back(i * 64 + static_cast<std::size_t>(__builtin_ctzll(w)));
+            w &= w - 1;
+        }
+    }
+    return out;
+}
+
+HostSet& HostSet::operator&=(const HostSet& other) {
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+        words_[i] &= i < other.words_.size() ? other.words_[i] : 0;
+    }
+    return *this;
+}
+
+HostSet& HostSet::operator|=(const HostSet& other) {
+    if (other.size_ > size_) {
+        words_.resize(other.words_.size(), 0);
+        size_ = other.size_;
+    }
+    for (std::size_t i = 0; i < other.words_.size(); ++i) {
+        words_[i] |= other.words_[i];
+    }
+    return *this;
+}
+
+HostSet& HostSet::operator-=(const HostSet& other) {
+    for (std::size_t i = 0; i < words_.size() && i < other.words_.size(); ++i) {
+        words_[i] &= ~other.words_[i];
+    }
+    return *this;
+}
+
+bool PortStateTable::find_host(const std::string& name, std::size_t& host) const {
+    for (std::size_t h = 0; h < host_count(); ++h) {
+        if (host_name(h) == name) {
+            host = h;
+            return true;
+        }
+    }
+    return false;
+}
+
+PortState PortStateTable::state(std::size_t host, int port) const {
+    if (port < 0 || port > 65535) {
+        return PortState::NOT_SCANNED;
+    }
+    BitmapView view = bitmap(host);
+    if (view.words) {
+        return static_cast<PortState>(dense_get(view.words, static_cast<unsigned>(port)));
+    }
+    // Last run starting at or before port.
+    const PortRun* end = view.runs + view.run_count;
+    const PortRun* it = std::upper_bound(view.runs, end, port,
+                                         [](int p, const PortRun& r) { return p < r.first; });
+    if (it == view.runs || (it - 1)->last < port) {
+        return PortState::NOT_SCANNED;
+    }
+    return static_cast<PortState>((it - 1)->state);
+}
+
+std::size_t PortStateTable::count(std::size_t host, PortState state) const {
+    // Port 0 is never probed; it is counted below and then excluded.
+    const uint8_t s = static_cast<uint8_t>(state);
+    BitmapView view = bitmap(host);
+    std::size_t n = 0;
+    if (view.words) {
+        // Replicate the 2-bit state across a word; matching fields XOR to 00.
+        const uint64_t pattern = 0x5555555555555555ull * s;
+        for (std::size_t i = 0; i < kDenseWords; ++i) {
+            uint64_t x = view.words[i] ^ pattern;
+            uint64_t zero = ~(x | (x >> 1)) & 0x5555555555555555ull;
+            n += static_cast<std::size_t>(__builtin_popcountll(zero));
+        }
+    } else {
+        std::size_t scanned = 0;
+        for (std::size_t i = 0; i < view.run_count; ++i) {
+            std::size_t len = static_cast<std::size_t>(view.runs[i].last - view.runs[i].first) + 1;
+            scanned += len;
+            if (view.runs[i].state == s) n += len;
+        }
+        if (state == PortState::NOT_SCANNED) n = 65536 - scanned;
+    }
+    if (n > 0 && this->state(host, 0) == state) --n;
+    return n;
+}
+
+std::vector<int> PortStateTable::ports_with(std::size_t host, PortState state) const {
+    const uint8_t s = static_cast<uint8_t>(state);
+    BitmapView view = bitmap(host);
+    std::vector<int> out;
+    if (view.words) {
+        for (unsigned port = 1; port < 65536; ++port) {
+            if (dense_get(view.words, port) == s) out.push_back(static_cast<int>(port));
+        }
+        return out;
+    }
+    if (state == PortState::NOT_SCANNED) {
+        int next = 1;
+        for (std::size_t i = 0; i < view.run_count; ++i) {
+            for (int p = next; p < view.runs[i].first; ++p) out.push_back(p);
+            next = std::max(next, view.runs[i].last + 1);
+        }
+        for (int p = next; p < 65536; ++p) out.push_back(p);
+        return out;
+    }
+    for (std::size_t i = 0; i < view.run_count; ++i) {
+        if (view.runs[i].state != s) continue;
+        for (int p = std::max(1, static_cast<int>(view.runs[i].first)); p <= view.runs[i].last; ++p) {
+            out.push_back(p);
+        }
+    }
+    return out;
+}
+
+HostSet PortStateTable::hosts_with(int port, PortState state) const {
+    const std::size_t n = host_count();
+    HostSet out(n);
+    for (std::size_t h = 0; h < n; ++h) {
+        if (this->state(h, port) == state) out.insert(h);
+    }
+    return out;
+}
+
+std::size_t ResultStore::add_host(const HostEntry& host) {
+    auto it = by_name_.find(host.name);
+    if (it != by_name_.end()) {
+        return it->second;
+    }
+    Host h;
+    h.entry = host;
+    hosts_.push_back(std::move(h));
+    by_name_.emplace(host.name, hosts_.size() - 1);
+    return hosts_.size() - 1;
+}
+
+std::size_t ResultStore::add_host(const std::string& name) {
+    auto it = by_name_.find(name);
+    if (it != by_name_.end()) {
+        return it->second;
+    }
+    HostEntry entry;
+    entry.name = name;
+    default_target_cache().lookup(name, entry.addr);
+    return add_host(entry);
+}
+
+bool ResultStore::find_host(const std::string& name, std::size_t& host) const {
+    auto it = by_name_.find(name);
+    if (it == by_name_.end()) {
+        return false;
+    }
+    host = it->second;
+    return true;
+}
+
+/**
+ * @brief Sets one port in a sorted run list, splitting and merging runs as needed.
+ *
+ * The common case, a port just past the last run, appends or extends in O(1).
+ */
+void ResultStore::set_run_state(std::vector<PortRun>& runs, uint16_t port, uint8_t state) {
+    if (runs.empty() || port > runs.back().last) {
+        if (!runs.empty() && runs.back().last + 1u == port && runs.back().state == state) {
+            runs.back().last = port;
+        } else {
+            runs.push_back(make_run(port, port, state));
+        }
+        return;
+    }
+
+    auto it = std::upper_bound(runs.begin(), runs.end(), port,
+                               [](uint16_t p, const PortRun& r) { return p < r.first; });
+    std::size_t i = static_cast<std::size_t>(it - runs.begin());
+    if (i > 0 && runs[i - 1].last >= port) {
+        PortRun old = runs[i - 1];
+        if (old.state == state) {
+            return;
+        }
+        // Split the covering run around port.
+        const std::size_t at = i - 1;
+        PortRun parts[3];
+        std::size_t nparts = 0;
+        if (old.first < port) parts[nparts++] = make_run(old.first, static_cast<uint16_t>(port - 1), old.state);
+        i = at + nparts;
+        parts[nparts++] = make_run(port, port, state);
+        if (port < old.last) parts[nparts++] = make_run(static_cast<uint16_t>(port + 1), old.last, old.state);
+        runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(at));
+        runs.insert(runs.begin() + static_cast<std::ptrdiff_t>(at), parts, parts + nparts);
+    } else {
+        runs.insert(runs.begin() + static_cast<std::ptrdiff_t>(i), make_run(port, port, state));
+    }
+
+    // Merge with neighbours that are now adjacent and equal.
+    if (i + 1 < runs.size() && runs[i].last + 1u == runs[i + 1].first && runs[i].state == runs[i + 1].state) {
+        runs[i].last = runs[i + 1].last;
+        runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(i + 1));
+    }
+    if (i > 0 && runs[i - 1].last + 1u == runs[i].first && runs[i - 1].state == runs[i].state) {
+        runs[i - 1].last = runs[i].last;
+        runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+}
+
+void ResultStore::to_dense(Host& host) {
+    host.words.assign(kDenseWords, 0);
+    for (const auto& r : host.runs) {
+        for (unsigned p = r.first; p <= r.last; ++p) {
+            dense_set(host.words.data(), p, r.state);
+        }
+    }
+    std::vector<PortRun>().swap(host.runs);
+}
+
+void ResultStore::record(std::size_t host, int port, PortStatus status) {
+    if (port < 0 || port > 65535) {
+        return;
+    }
+    Host& h = hosts_[host];
+    const uint8_t s = static_cast<uint8_t>(to_port_state(status));
+    if (!h.words.empty()) {
+        dense_set(h.words.data(), static_cast<unsigned>(port), s);
+        return;
+    }
+    set_run_state(h.runs, static_cast<uint16_t>(port), s);
+    if (h.runs.size() > kDenseRunLimit) {
+        to_dense(h);
+    }
+}
+
+void ResultStore::record_cert(std::size_t host, int port, const CertInfo& info) {
+    certs_[std::make_pair(host, port)] = info;
+    if (info.valid()) {
+        record(host, port, PortStatus::OPEN);
+    } else if (state(host, port) == PortState::NOT_SCANNED) {
+        record(host, port, PortStatus::CLOSED);
+    }
+}
+
+bool ResultStore::cert(std::size_t host, int port, CertInfo& out) const {
+    auto it = certs_.find(std::make_pair(host, port));
+    if (it == certs_.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+PortStateTable::BitmapView ResultStore::bitmap(std::size_t host) const {
+    const Host& h = hosts_[host];
+    if (!h.words.empty()) {
+        return BitmapView{h.words.data(), nullptr, 0};
+    }
+    return BitmapView{nullptr, h.runs.data(), h.runs.size()};
+}
+
+void ResultStore::compact() {
+    for (auto& h : hosts_) {
+        if (h.words.empty()) {
+            h.runs.shrink_to_fit();
+            continue;
+        }
+        if (dense_run_count(h.words.data(), kDenseRunLimit) <= kDenseRunLimit) {
+            runs_from_dense(h.words.data(), h.runs);
+            h.runs.shrink_to_fit();
+            std::vector<uint64_t>().swap(h.words);
+        }
+    }
+}
+
+std::size_t ResultStore::memory_bytes() const {
+    std::size_t bytes = hosts_.capacity() * sizeof(Host);
+    for (const auto& h : hosts_) {
+        bytes += h.runs.capacity() * sizeof(PortRun) + h.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+void ResultStore::clear() {
+    hosts_.clear();
+    by_name_.clear();
+    certs_.clear();
+}
+
+bool ResultStore::save(const std::string& path) {
+    compact();
+
+    std::string strings;
+    std::vector<StoreHost> host_table(hosts_.size());
+    uint64_t data_offset = sizeof(StoreHeader) + hosts_.size() * sizeof(StoreHost) +
+                           certs_.size() * sizeof(StoreCert);
+    data_offset = (data_offset + 7) & ~uint64_t(7);
+    for (std::size_t i = 0; i < hosts_.size(); ++i) {
+        const Host& h = hosts_[i];
+        StoreHost& e = host_table[i];
+        std::memset(&e, 0, sizeof(e));
+        std::memcpy(e.addr, h.entry.addr.bytes, sizeof(e.addr));
+        e.scope_id = h.entry.addr.scope_id;
+        e.family = h.entry.addr.family == AF_INET ? 4 : h.entry.addr.family == AF_INET6 ? 6 : 0;
+        e.dense = h.words.empty() ? 0 : 1;
+        e.name = add_string(strings, h.entry.name);
+        e.run_count = static_cast<uint32_t>(h.runs.size());
+        e.data_offset = data_offset;
+        data_offset += e.dense ? kDenseWords * sizeof(uint64_t) : h.runs.size() * sizeof(PortRun);
+    }
+
+    // Ports sharing a certificate share its strings in the file as well.
+    std::vector<StoreCert> cert_table;
+    cert_table.reserve(certs_.size());
+    std::unordered_map<const CertRecord*, StoreCert> cert_strings;
+    for (const auto& kv : certs_) {
+        const CertInfo& info = kv.second;
+        StoreCert c;
+        std::memset(&c, 0, sizeof(c));
+        if (info.valid()) {
+            auto it = cert_strings.find(info.record());
+            if (it == cert_strings.end()) {
+                StoreCert& s = cert_strings[info.record()];
+                std::memset(&s, 0, sizeof(s));
+                s.flags = kRecordCertValid;
+                if (info.self_signed()) s.flags |= kRecordSelfSigned;
+                s.subject = add_string(strings, info.subject());
+                s.issuer = add_string(strings, info.issuer());
+                s.not_after = add_string(strings, info.not_after());
+                if (info.record()->has_fingerprint()) {
+                    std::memcpy(s.fingerprint, info.record()->fingerprint().data(), sizeof(s.fingerprint));
+                }
+                it = cert_strings.find(info.record());
+            }
+            c = it->second;
+        } else {
+            c.subject = c.issuer = c.not_after = add_string(strings, std::string());
+        }
+        c.host = static_cast<uint32_t>(kv.first.first);
+        c.port = static_cast<uint16_t>(kv.first.second);
+        cert_table.push_back(c);
+    }
+
+    StoreHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kStoreMagic, sizeof(header.magic));
+    header.version = kStoreVersion;
+    header.endian = kBinaryEndianMark;
+    header.host_count = static_cast<uint32_t>(host_table.size());
+    header.cert_count = static_cast<uint32_t>(cert_table.size());
+    header.hosts_offset = sizeof(StoreHeader);
+    header.certs_offset = header.hosts_offset + host_table.size() * sizeof(StoreHost);
+    header.strings_offset = data_offset;
+    header.strings_size = strings.size();
+
+    // Write to a temporary file and rename so readers never map a partial store.
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Error: cannot open result store '" << tmp << "' - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    static const char zeros[8] = {};
+    std::size_t tables_end = sizeof(StoreHeader) + host_table.size() * sizeof(StoreHost) +
+                             cert_table.size() * sizeof(StoreCert);
+    bool ok = write_all(f, &header, sizeof(header)) &&
+              write_all(f, host_table.data(), host_table.size() * sizeof(StoreHost)) &&
+              write_all(f, cert_table.data(), cert_table.size() * sizeof(StoreCert)) &&
+              write_all(f, zeros, ((tables_end + 7) & ~std::size_t(7)) - tables_end);
+    for (std::size_t i = 0; ok && i < hosts_.size(); ++i) {
+        const Host& h = hosts_[i];
+        ok = h.words.empty() ? write_all(f, h.runs.data(), h.runs.size() * sizeof(PortRun))
+                             : write_all(f, h.words.data(), kDenseWords * sizeof(uint64_t));
+    }
+    ok = ok && write_all(f, strings.data(), strings.size());
+    if (std::fclose(f) != 0) ok = false;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: failed to write result store '" << path << "' - " << std::strerror(errno) << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedResultStore::MappedResultStore() : base_(nullptr), size_(0), cert_size_(sizeof(StoreCert)) {}
+
+MappedResultStore::~MappedResultStore() {
+    close();
+}
+
+void MappedResultStore::close() {
+    if (base_) {
+        munmap(const_cast<uint8_t*>(base_), size_);
+        base_ = nullptr;
+        size_ = 0;
+    }
+}
+
+bool MappedResultStore::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open result store '" << path << "' - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(StoreHeader)) {
+        std::cerr << "Error: '" << path << "' is not a result store.\n";
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: mmap() of '" << path << "' failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    base_ = static_cast<const uint8_t*>(base);
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    // Validate every offset once so that queries need no bounds checks.
+    const StoreHeader* h = reinterpret_cast<const StoreHeader*>(base_);
+    cert_size_ = h->version == 1 ? kStoreCertV1Size : sizeof(StoreCert);
+    bool ok = std::memcmp(h->magic, kStoreMagic, sizeof(h->magic)) == 0 &&
+              (h->version == kStoreVersion || h->version == 1) && h->endian == kBinaryEndianMark &&
+              h->hosts_offset == sizeof(StoreHeader) &&
+              h->certs_offset == h->hosts_offset + uint64_t(h->host_count) * sizeof(StoreHost) &&
+              h->certs_offset + uint64_t(h->cert_count) * cert_size_ <= h->strings_offset &&
+              h->strings_offset + h->strings_size == size_ &&
+              (h->strings_size == 0 || base_[size_ - 1] == '\0');
+    const StoreHost* hosts = reinterpret_cast<const StoreHost*>(base_ + sizeof(StoreHeader));
+    for (uint32_t i = 0; ok && i < h->host_count; ++i) {
+        uint64_t len = hosts[i].dense ? kDenseWords * sizeof(uint64_t) : uint64_t(hosts[i].run_count) * sizeof(PortRun);
+        ok = hosts[i].data_offset % 8 == 0 && hosts[i].data_offset + len <= h->strings_offset &&
+             hosts[i].name < h->strings_size;
+    }
+    for (uint32_t i = 0; ok && i < h->cert_count; ++i) {
+        const StoreCert* c = reinterpret_cast<const StoreCert*>(base_ + h->certs_offset + i * cert_size_);
+        ok = c->host < h->host_count && c->subject < h->strings_size && c->issuer < h->strings_size &&
+             c->not_after < h->strings_size;
+    }
+    if (!ok) {
+        std::cerr << "Error: '" << path << "' is not a valid result store.\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+std::size_t MappedResultStore::host_count() const {
+    return base_ ? reinterpret_cast<const StoreHeader*>(base_)->host_count : 0;
+}
+
+const char* MappedResultStore::string_at(uint32_t offset) const {
+    return reinterpret_cast<const char*>(base_ + reinterpret_cast<const StoreHeader*>(base_)->strings_offset + offset);
+}
+
+std::string MappedResultStore::host_name(std::size_t host) const {
+    const StoreHost* e = reinterpret_cast<const StoreHost*>(base_ + sizeof(StoreHeader)) + host;
+    return string_at(e->name);
+}
+
+TargetAddress MappedResultStore::host_addr(std::size_t host) const {
+    const StoreHost* e = reinterpret_cast<const StoreHost*>(base_ + sizeof(StoreHeader)) + host;
+    TargetAddress addr;
+    addr.family = e->family == 4 ? AF_INET : e->family == 6 ? AF_INET6 : AF_UNSPEC;
+    addr.scope_id = e->scope_id;
+    std::memcpy(addr.bytes, e->addr, sizeof(addr.bytes));
+    return addr;
+}
+
+bool MappedResultStore::cert(std::size_t host, int port, CertInfo& out) const {
+    const StoreHeader* h = reinterpret_cast<const StoreHeader*>(base_);
+    auto entry = [&](std::size_t i) {
+        return reinterpret_cast<const StoreCert*>(base_ + h->certs_offset + i * cert_size_);
+    };
+    // Certificates are written sorted by (host, port).
+    std::size_t lo = 0, hi = h->cert_count;
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        const StoreCert* c = entry(mid);
+        if (std::make_pair(static_cast<std::size_t>(c->host), static_cast<int>(c->port)) < std::make_pair(host, port)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const StoreCert* it = lo < h->cert_count ? entry(lo) : nullptr;
+    if (!it || it->host != host || it->port != port) {
+        return false;
+    }
+    if (it->flags & kRecordCertValid) {
+        CertFingerprint fingerprint = CertFingerprint();
+        if (cert_size_ == sizeof(StoreCert)) {
+            std::memcpy(fingerprint.data(), it->fingerprint, fingerprint.size());
+        }
+        out = CertInfo::from_fields(string_at(it->subject), string_at(it->issuer), string_at(it->not_after),
+                                    (it->flags & kRecordSelfSigned) != 0, fingerprint);
+    } else {
+        out = CertInfo();
+    }
+    return true;
+}
+
+PortStateTable::BitmapView MappedResultStore::bitmap(std::size_t host) const {
+    const StoreHost* e = reinterpret_cast<const StoreHost*>(base_ + sizeof(StoreHeader)) + host;
+    const uint8_t* data = base_ + e->data_offset;
+    if (e->dense) {
+        return BitmapView{reinterpret_cast<const uint64_t*>(data), nullptr, 0};
+    }
+    return BitmapView{nullptr, reinterpret_cast<const PortRun*>(data), e->run_count};
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include "scanner.h"
+#include "cert_utils.h"
+#include "target_spec.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Per-port state as stored in a result bitmap (two bits per port).
+ *
+ * NOT_SCANNED is zero so that an untouched bitmap means "nothing known".
+ */
+enum class PortState : uint8_t { NOT_SCANNED = 0, OPEN = 1, CLOSED = 2, FILTERED = 3 };
+
+/** @brief Maps a probe result onto its stored state. */
+PortState to_port_state(PortStatus status);
+
+/** @brief Converts a stored state to a string ("NOT_SCANNED", "OPEN", ...). */
+std::string port_state_to_string(PortState state);
+
+/**
+ * @brief A run of consecutive ports sharing one state; 8 bytes.
+ *
+ * Ports between runs are NOT_SCANNED.
+ */
+struct PortRun {
+    uint16_t first;      ///< First port of the run.
+    uint16_t last;       ///< Last port of the run (inclusive).
+    uint8_t state;       ///< PortState value.
+    uint8_t reserved[3];
+};
+
+/**
+ * @brief Dense bit set over host indices, used for query results.
+ *
+ * Combining sets is word-at-a-time, so "hosts with 22 and 3389 open" over a
+ * /16 is a few thousand AND instructions once each port's set is built.
+ */
+class HostSet {
+public:
+    explicit HostSet(std::size_t host_count = 0)
+        : words_((host_count + 63) / 64, 0), size_(host_count) {}
+
+    void insert(std::size_t host) { words_[host >> 6] |= 1ull << (host & 63); }
+    bool contains(std::size_t host) const { return (words_[host >> 6] >> (host & 63)) & 1u; }
+
+    /** @brief Number of host indices this set can hold. */
+    std::size_t capacity() const { return size_; }
+
+    /** @brief Number of hosts in the set. */
+    std::size_t count() const;
+
+    /** @brief Host indices in the set, ascending. */
+    std::vector<std::size_t> to_vector() const;
+
+    HostSet& operator&=(const HostSet& other);  ///< Intersection.
+    HostSet& operator|=(const HostSet& other);  ///< Union.
+    HostSet& operator-=(const HostSet& other);  ///< Difference.
+
+private:
+    std::vector<uint64_t> words_;
+    std::size_t size_;
+};
+
+inline HostSet operator&(HostSet a, const HostSet& b) { return a &= b; }
+inline HostSet operator|(HostSet a, const HostSet& b) { return a |= b; }
+inline HostSet operator-(HostSet a, const HostSet& b) { return a -= b; }
+
+/**
+ * @brief Read-only queries shared by ResultStore and MappedResultStore.
+ *
+ * Each host's 65536 port states are held either as a run-length list of
+ * PortRun entries (sparse hosts: a filtered host is one run) or as a dense
+ * 16 KiB bitmap with two bits per port (hosts with many state changes).
+ * Both encodings use the same layout in memory and on disk.
+ */
+class PortStateTable {
+public:
+    virtual ~PortStateTable() {}
+
+    /** @brief Number of hosts in the table. */
+    virtual std::size_t host_count() const = 0;
+
+    /** @brief Name of a host as given to the scanner. */
+    virtual std::string host_name(std::size_t host) const = 0;
+
+    /** @brief Address of a host (family AF_UNSPEC if it was not resolved). */
+    virtual TargetAddress host_addr(std::size_t host) const = 0;
+
+    /**
+     * @brief Looks up certificate details recorded for a host and port.
+     * @return false if no handshake result was recorded.
+     */
+    virtual bool cert(std::size_t host, int port, CertInfo& out) const = 0;
+
+    /**
+     * @brief Finds a host by name.
+     * @return false if the name is not in the table.
+     */
+    virtual bool find_host(const std::string& name, std::size_t& host) const;
+
+    /** @brief State of one port on one host. */
+    PortState state(std::size_t host, int port) const;
+
+    /** @brief Number of ports on a host in the given state. */
+    std::size_t count(std::size_t host, PortState state) const;
+
+    /** @brief Ports on a host in the given state, ascending. */
+    std::vector<int> ports_with(std::size_t host, PortState state) const;
+
+    /** @brief Hosts whose port is in the given state. */
+    HostSet hosts_with(int port, PortState state) const;
+
+protected:
+    /** @brief Borrowed view of one host's encoded bitmap. */
+    struct BitmapView {
+        const uint64_t* words;  ///< Dense form (2048 words), or nullptr.
+        const PortRun* runs;    ///< Run-length form, used when words is nullptr.
+        std::size_t run_count;
+    };
+
+    virtual BitmapView bitmap(std::size_t host) const = 0;
+};
+
+/**
+ * @brief In-memory result store for host x port matrices.
+ *
+ * Hosts start in run-length form; results arriving in port order (as every
+ * scanner in this tree emits them) extend the last run in O(1). A host is
+ * converted to the dense bitmap once its run list would outgrow it, and
+ * compact() converts dense hosts back when runs are smaller again.
+ *
+ * A /16 sweep of one port costs one run (8 bytes) per host; a full-range
+ * scan of a busy host costs at most 16 KiB. Not thread-safe: callers that
+ * record from several threads must serialise.
+ */
+class ResultStore : public PortStateTable {
+public:
+    ResultStore() {}
+
+    /**
+     * @brief Registers a host, or returns the existing index for its name.
+     * @param host Target name and address.
+     * @return Host index.
+     */
+    std::size_t add_host(const HostEntry& host);
+
+    /**
+     * @brief Registers a host by name, resolving it through default_target_cache() if new.
+     * @param name Hostname or numeric address.
+     * @return Host index (the address is AF_UNSPEC if the name does not resolve).
+     */
+    std::size_t add_host(const std::string& name);
+
+    /**
+     * @brief Records a probe result.
+     * @param host Index from add_host().
+     * @param port TCP port.
+     * @param status Result.
+     */
+    void record(std::size_t host, int port, PortStatus status);
+
+    /**
+     * @brief Records a certificate retrieval result.
+     *
+     * The port is marked OPEN when a certificate was retrieved. A failed
+     * handshake marks it CLOSED only if nothing was recorded for it yet, so
+     * an earlier TCP result is not overwritten.
+     * @param host Index from add_host().
+     * @param port Port the handshake was attempted on.
+     * @param info Certificate details.
+     */
+    void record_cert(std::size_t host, int port, const CertInfo& info);
+
+    /** @brief Converts dense hosts back to runs where that is smaller. */
+    void compact();
+
+    /** @brief Approximate heap bytes used by the port bitmaps. */
+    std::size_t memory_bytes() const;
+
+    /**
+     * @brief Writes the store in the memory-mappable format read by MappedResultStore.
+     * @param path Output file (replaced).
+     * @return false on I/O error (an error is printed).
+     */
+    bool save(const std::string& path);
+
+    /** @brief Drops every host and result. */
+    void clear();
+
+    std::size_t host_count() const override { return hosts_.size(); }
+    std::string host_name(std::size_t host) const override { return hosts_[host].entry.name; }
+    TargetAddress host_addr(std::size_t host) const override { return hosts_[host].entry.addr; }
+    bool cert(std::size_t host, int port, CertInfo& out) const override;
+    bool find_host(const std::string& name, std::size_t& host) const override;
+
+protected:
+    BitmapView bitmap(std::size_t host) const override;
+
+private:
+    struct Host {
+        HostEntry entry;
+        std::vector<PortRun> runs;
+        std::vector<uint64_t> words;  ///< Non-empty once the host is dense.
+    };
+
+    static void set_run_state(std::vector<PortRun>& runs, uint16_t port, uint8_t state);
+    static void to_dense(Host& host);
+
+    std::vector<Host> hosts_;
+    std::unordered_map<std::string, std::size_t> by_name_;
+    std::map<std::pair<std::size_t, int>, CertInfo> certs_;
+};
+
+/**
+ * @brief Read-only view of a file written by ResultStore::save().
+ *
+ * The file is mapped rather than read, so opening a large result set is
+ * O(1) and queries touch only the pages for the hosts they inspect.
+ */
+class MappedResultStore : public PortStateTable {
+public:
+    MappedResultStore();
+    ~MappedResultStore();
+
+    MappedResultStore(const MappedResultStore&) = delete;
+    MappedResultStore& operator=(const MappedResultStore&) = delete;
+
+    /**
+     * @brief Maps a result file.
+     * @param path File written by ResultStore::save().
+     * @return false if the file is missing or malformed (an error is printed).
+     */
+    bool open(const std::string& path);
+
+    /** @brief Unmaps the file. */
+    void close();
+
+    std::size_t host_count() const override;
+    std::string host_name(std::size_t host) const override;
+    TargetAddress host_addr(std::size_t host) const override;
+    bool cert(std::size_t host, int port, CertInfo& out) const override;
+
+protected:
+    BitmapView bitmap(std::size_t host) const override;
+
+private:
+    const char* string_at(uint32_t offset) const;
+
+    const uint8_t* base_;
+    std::size_t size_;
+    std::size_t cert_size_;  ///< Bytes per certificate entry; version 1 files have no fingerprint.
+};
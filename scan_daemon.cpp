@@ -0,0 +1,1061 @@
+#include "scan_daemon.h"
+#include "result_sink.h"
+#include "timer_wheel.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+
+/// Largest hosts x ports an ad-hoc scan may ask for.
+const std::size_t kMaxAdhocProbes = 65536;
+/// Longest command line a client may send.
+const std::size_t kMaxCommandLength = 4096;
+/// Clients that send no complete command, or stop reading their reply, for
+/// this long are dropped.
+const uint64_t kClientTimeoutMs = 5000;
+/// Entries due this soon are folded into the current batch, so results that
+/// came back a few milliseconds apart are rescanned together.
+const uint64_t kBatchSlackMs = 1000;
+/// Due entries handed to the scheduler's prober per refill, so entries that
+/// fall due meanwhile are ranked again soon.
+const std::size_t kRefillChunk = 64;
+/// Targets a prober may collect (ad-hoc hosts, re-resolved addresses) before
+/// it is replaced; configs with more hosts get twice their host count.
+const std::size_t kLaneTargetLimit = 65536;
+/// Most ad-hoc-only results kept; beyond this the oldest are dropped even
+/// if they are younger than max_age.
+const std::size_t kMaxAdhocEntries = 262144;
+/// Ad-hoc-only entry count at which the first prune runs.
+const std::size_t kMinPruneAt = 4096;
+
+volatile sig_atomic_t g_stop = 0;
+volatile sig_atomic_t g_reload = 0;
+int g_wake_fd = -1;
+
+/**
+ * @brief SIGHUP requests a reload, SIGINT/SIGTERM a stop; either wakes the server loop.
+ */
+void on_signal(int sig) {
+    if (sig == SIGHUP) {
+        g_reload = 1;
+    } else {
+        g_stop = 1;
+    }
+    uint64_t one = 1;
+    ssize_t n = write(g_wake_fd, &one, sizeof(one));
+    (void)n;
+}
+
+bool same_address(const TargetAddress& a, const TargetAddress& b) {
+    return a.family == b.family && a.scope_id == b.scope_id && std::memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+std::string key_of(const std::string& host, int port) {
+    return host + ' ' + std::to_string(port);
+}
+
+/**
+ * @brief Parses a whole-string integer in [min, max].
+ */
+bool parse_long(const std::string& text, long min, long max, long& out) {
+    char* end;
+    errno = 0;
+    long val = std::strtol(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str() || *end != '\0' || val < min || val > max) {
+        return false;
+    }
+    out = val;
+    return true;
+}
+
+/**
+ * @brief Parses "22,443,8000-8010" into ports in the order given, without duplicates.
+ */
+bool parse_ports(const std::string& text, std::vector<int>& out) {
+    std::unordered_set<int> seen;
+    std::size_t begin = 0;
+    for (;;) {
+        std::size_t comma = text.find(',', begin);
+        std::string item = text.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin);
+        std::size_t dash = item.find('-');
+        long first, last;
+        if (!parse_long(item.substr(0, dash), 1, 65535, first)) {
+            return false;
+        }
+        last = first;
+        if (dash != std::string::npos && !parse_long(item.substr(dash + 1), first, 65535, last)) {
+            return false;
+        }
+        for (long port = first; port <= last; ++port) {
+            if (seen.insert(static_cast<int>(port)).second) out.push_back(static_cast<int>(port));
+        }
+        if (comma == std::string::npos) {
+            return true;
+        }
+        begin = comma + 1;
+    }
+}
+
+} // namespace
+
+ScanDaemon::ScanDaemon(const std::string& config_path, const std::string& format)
+    : config_path_(config_path),
+      format_(format),
+      listen_fd_(-1),
+      wake_fd_(-1),
+      started_ms_(monotonic_ms()),
+      stop_(false),
+      host_count_(0),
+      scheduled_count_(0),
+      prune_at_(kMinPruneAt),
+      generation_(0),
+      batches_(0),
+      probes_(0),
+      adhoc_jobs_(0),
+      cache_hits_(0) {}
+
+ScanDaemon::~ScanDaemon() {
+    shutdown();
+}
+
+bool ScanDaemon::start() {
+    // A client that hangs up mid-reply must not kill the daemon.
+    struct sigaction ignore;
+    std::memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, nullptr);
+
+    if (format_ != "text" && format_ != "jsonl" && format_ != "binary") {
+        std::cerr << "Error: unknown output format '" << format_ << "' (expected text, jsonl or binary).\n";
+        return false;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        std::cerr << "Error: eventfd() failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    std::string summary;
+    if (!load(summary)) {
+        return false;
+    }
+    socket_path_ = config_.socket_path;
+    if (!bind_socket()) {
+        return false;
+    }
+
+    g_wake_fd = wake_fd_;
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cerr << summary << "; listening on " << socket_path_ << "\n";
+    scheduler_ = std::thread(&ScanDaemon::scheduler_main, this);
+    jobs_thread_ = std::thread(&ScanDaemon::jobs_main, this);
+    return true;
+}
+
+/**
+ * @brief Reads the config and rebuilds the schedule, keeping results for
+ *        host x port pairs that are still configured.
+ * @param summary One-line description of the outcome, for the log and the client.
+ * @return false if the config is invalid; the previous one stays in effect.
+ */
+bool ScanDaemon::load(std::string& summary) {
+    DaemonConfig config;
+    std::vector<HostEntry> hosts;
+    bool ok = load_daemon_config(config_path_, config);
+    for (std::size_t i = 0; ok && i < config.targets.size(); ++i) {
+        ok = parse_targets(config.targets[i], hosts);
+    }
+    if (!ok) {
+        summary = "ERROR: config '" + config_path_ + "' not loaded; see the daemon's log";
+        return false;
+    }
+
+    const uint64_t now = monotonic_ms();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, std::size_t> index;
+    std::unordered_set<std::string> names;
+    for (const HostEntry& host : hosts) {
+        if (!names.insert(host.name).second) {
+            continue;
+        }
+        for (const PortConfig& portcfg : config.ports) {
+            std::string key = key_of(host.name, portcfg.port);
+            if (index.count(key)) {
+                continue;
+            }
+            Entry e;
+            auto it = index_.find(key);
+            if (it != index_.end() && entries_[it->second].scanned) {
+                e = entries_[it->second];
+            } else {
+                e.due_ms = now;
+            }
+            e.host = host;
+            e.port = portcfg.port;
+            e.protocol = portcfg.protocol;
+            e.scheduled = true;
+            index.emplace(std::move(key), entries.size());
+            entries.push_back(std::move(e));
+        }
+    }
+
+    if (!socket_path_.empty() && config.socket_path != socket_path_) {
+        std::cerr << "Note: socket path changes take effect on restart; still listening on " << socket_path_
+                  << ".\n";
+    }
+    config_ = config;
+    host_count_ = names.size();
+    entries_.swap(entries);
+    scheduled_count_ = entries_.size();
+    index_.swap(index);
+    ++generation_;
+    due_ = decltype(due_)();
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+        due_.push({entries_[i].due_ms, rank_of(entries_[i]), i, generation_});
+    }
+    scheduler_cv_.notify_all();
+
+    summary = "Loaded " + std::to_string(host_count_) + " hosts x " + std::to_string(config_.ports.size()) +
+              " ports (" + std::to_string(entries_.size()) + " entries) from " + config_path_;
+    return true;
+}
+
+/**
+ * @brief Listens on socket_path_, owner-only; replaces a stale socket left by a
+ *        daemon that did not shut down, but never a live one or a regular file.
+ */
+bool ScanDaemon::bind_socket() {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path_.empty() || socket_path_.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path '" << socket_path_ << "' is empty or too long.\n";
+        return false;
+    }
+    std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+    struct stat st;
+    if (lstat(socket_path_.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << "Error: '" << socket_path_ << "' exists and is not a socket.\n";
+            return false;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            std::cerr << "Error: another daemon is already listening on '" << socket_path_ << "'.\n";
+            return false;
+        }
+        unlink(socket_path_.c_str());
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "Error: socket() failed - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    mode_t old_mask = umask(077);
+    int rc = bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(old_mask);
+    if (rc < 0 || listen(listen_fd_, 64) < 0) {
+        std::cerr << "Error: cannot listen on '" << socket_path_ << "' - " << std::strerror(errno) << "\n";
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stops both scan threads, drops waiting clients and removes the socket.
+ */
+void ScanDaemon::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    scheduler_cv_.notify_all();
+    jobs_cv_.notify_all();
+    if (scheduler_.joinable()) scheduler_.join();
+    if (jobs_thread_.joinable()) jobs_thread_.join();
+
+    for (const auto& job : jobs_) {
+        if (job->fd >= 0) close(job->fd);
+    }
+    for (const auto& job : finished_) close(job->fd);
+    jobs_.clear();
+    finished_.clear();
+    for (const Client& c : clients_) close(c.fd);
+    clients_.clear();
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+        listen_fd_ = -1;
+    }
+    if (wake_fd_ >= 0) {
+        g_wake_fd = -1;
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+bool ScanDaemon::near_expiry(const Entry& e) const {
+    if (!e.cert.valid()) {
+        return false;
+    }
+    time_t expiry = e.cert.not_after_time();
+    return expiry != 0 && expiry - std::time(nullptr) < static_cast<time_t>(config_.expiry_days) * 86400;
+}
+
+unsigned ScanDaemon::rank_of(const Entry& e) const {
+    if (near_expiry(e)) return 0;
+    return e.scanned && e.status == PortStatus::OPEN ? 1 : 2;
+}
+
+/**
+ * @brief Probe for a scheduled rescan: HTTPS ports only handshake when their
+ *        certificate is missing, near expiry or older than cert_interval.
+ */
+ServiceProtocol ScanDaemon::protocol_for(const Entry& e, uint64_t now) const {
+    ServiceProtocol protocol = service_protocol_for(e.protocol);
+    if (protocol != ServiceProtocol::TLS || !e.cert.valid() || near_expiry(e) ||
+        now - e.cert_ms >= static_cast<uint64_t>(config_.cert_interval_s) * 1000) {
+        return protocol;
+    }
+    return ServiceProtocol::NONE;
+}
+
+std::string ScanDaemon::label_for(int port) const {
+    for (const PortConfig& portcfg : config_.ports) {
+        if (portcfg.port == port) return portcfg.protocol;
+    }
+    return std::string();
+}
+
+/**
+ * @brief Finds the entry for key, adding an unscheduled one if there is none.
+ */
+std::size_t ScanDaemon::entry_for(const std::string& key, const HostEntry& host, int port, uint64_t now) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        return it->second;
+    }
+    if (entries_.size() - scheduled_count_ >= prune_at_) {
+        prune_adhoc(now);
+    }
+    Entry e;
+    e.host = host;
+    e.port = port;
+    e.protocol = label_for(port);
+    index_.emplace(key, entries_.size());
+    entries_.push_back(std::move(e));
+    return entries_.size() - 1;
+}
+
+/**
+ * @brief Drops ad-hoc-only entries probed more than max_age ago, then the
+ *        oldest ones while more than kMaxAdhocEntries would remain.
+ *
+ * Only the tail of entries_ after the configured entries moves, so the
+ * indices held by due_ stay valid.
+ */
+void ScanDaemon::prune_adhoc(uint64_t now) {
+    const uint64_t max_age_ms = static_cast<uint64_t>(config_.max_age_s) * 1000;
+    uint64_t cutoff = now > max_age_ms ? now - max_age_ms : 0;
+    std::vector<uint64_t> fresh;
+    for (std::size_t i = scheduled_count_; i < entries_.size(); ++i) {
+        if (entries_[i].scanned_ms >= cutoff) fresh.push_back(entries_[i].scanned_ms);
+    }
+    if (fresh.size() > kMaxAdhocEntries) {
+        // Evict down to three quarters of the cap so the next prune is not
+        // due again after a single insert.
+        std::size_t drop = fresh.size() - kMaxAdhocEntries * 3 / 4;
+        std::nth_element(fresh.begin(), fresh.begin() + static_cast<std::ptrdiff_t>(drop), fresh.end());
+        cutoff = fresh[drop];
+    }
+
+    std::size_t out = scheduled_count_;
+    for (std::size_t i = scheduled_count_; i < entries_.size(); ++i) {
+        Entry& e = entries_[i];
+        if (e.scanned_ms < cutoff) {
+            index_.erase(key_of(e.host.name, e.port));
+            continue;
+        }
+        if (out != i) {
+            entries_[out] = std::move(e);
+            index_[key_of(entries_[out].host.name, entries_[out].port)] = out;
+        }
+        ++out;
+    }
+    entries_.erase(entries_.begin() + static_cast<std::ptrdiff_t>(out), entries_.end());
+    prune_at_ = std::min(std::max(2 * (out - scheduled_count_), kMinPruneAt), kMaxAdhocEntries);
+}
+
+void ScanDaemon::schedule(std::size_t index, uint64_t now) {
+    Entry& e = entries_[index];
+    uint32_t interval = e.status == PortStatus::OPEN ? config_.open_interval_s : config_.interval_s;
+    e.due_ms = now + static_cast<uint64_t>(interval) * 1000;
+    due_.push({e.due_ms, rank_of(e), index, generation_});
+    scheduler_cv_.notify_one();
+}
+
+/**
+ * @brief Stores one probe result and, for configured entries, schedules the next rescan.
+ */
+void ScanDaemon::apply(const Probe& probe, const ServiceResult& r, uint64_t now) {
+    std::size_t index = entry_for(probe.key, probe.host, probe.port, now);
+    Entry& e = entries_[index];
+    e.host.addr = probe.host.addr;
+    e.scanned = true;
+    e.status = r.status;
+    e.scanned_ms = now;
+    if (r.status != PortStatus::OPEN) {
+        e.service.clear();
+        e.cert = CertInfo();
+    } else if (probe.protocol != ServiceProtocol::NONE) {
+        e.service = r.identified ? std::string(r.banner, r.banner_len) : std::string();
+        if (probe.protocol == ServiceProtocol::TLS) {
+            e.cert = r.cert;
+            e.cert_ms = now;
+        }
+    }
+    ++probes_;
+    if (e.scheduled) {
+        schedule(index, now);
+    }
+}
+
+bool ScanDaemon::is_stale(const Due& d) const {
+    return d.generation != generation_ || entries_[d.entry].due_ms != d.due_ms;
+}
+
+/**
+ * @brief Drives the lane's prober until its refill runs dry. Called without
+ *        mutex_ held.
+ *
+ * The prober is only replaced when the config changed its options or it has
+ * collected too many stale targets; estimates move over through the resolver
+ * cache. Probes that got no result because the event loop failed are
+ * completed without one.
+ * @param eager Also poll refill after every result; the prober only asks for
+ *        more work once its queue is empty, which a large ad-hoc scan keeps
+ *        it from being for a long time.
+ */
+void ScanDaemon::run_lane(Lane& lane, const std::function<bool()>& refill, bool eager) {
+    ServiceProberOptions options;
+    std::size_t max_targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options.timeout_ms = config_.timeout_ms;
+        options.max_in_flight = config_.concurrency;
+        max_targets = std::max(kLaneTargetLimit, 2 * host_count_);
+    }
+    if (!lane.prober || lane.timeout_ms != options.timeout_ms || lane.concurrency != options.max_in_flight ||
+        lane.names.size() > max_targets) {
+        if (lane.prober) {
+            for (const auto& target : lane.targets) {
+                default_target_cache().record_rtt(target.first, lane.prober->target_rtt(target.second));
+            }
+        }
+        lane.prober.reset(new ServiceProber(options));
+        lane.timeout_ms = options.timeout_ms;
+        lane.concurrency = options.max_in_flight;
+        lane.targets.clear();
+        lane.names.clear();
+        lane.addrs.clear();
+    }
+
+    bool ok = lane.prober->run(
+        [&](const ServiceResult& r) {
+            auto it = lane.in_flight.find(key_of(lane.names[r.target], r.port));
+            if (it == lane.in_flight.end()) {
+                return;
+            }
+            InFlight done = std::move(it->second);
+            lane.in_flight.erase(it);
+            complete(done.probe, done.jobs, &r);
+            if (eager) refill();
+        },
+        refill);
+
+    std::unordered_map<std::string, InFlight> lost;
+    lost.swap(lane.in_flight);
+    for (const auto& item : lost) {
+        complete(item.second.probe, item.second.jobs, nullptr);
+    }
+    if (!ok) {
+        lane.prober.reset();
+    }
+}
+
+/**
+ * @brief Hands one probe to the lane's prober, or attaches job to the same
+ *        probe if it is already in flight. Called without mutex_ held.
+ *
+ * Addresses are looked up again through the shared resolver cache, so names
+ * are re-resolved once their TTL expires; a new address becomes a new target
+ * that starts from the old one's RTT estimate.
+ */
+void ScanDaemon::submit_probe(Lane& lane, const Probe& probe, const std::shared_ptr<Job>& job) {
+    auto pending = lane.in_flight.find(probe.key);
+    if (pending != lane.in_flight.end()) {
+        if (job) pending->second.jobs.push_back(job);
+        return;
+    }
+    InFlight item{probe, std::vector<std::shared_ptr<Job>>()};
+    if (job) item.jobs.push_back(job);
+    const std::string& name = probe.host.name;
+    TargetAddress& addr = item.probe.host.addr;
+    if (!default_target_cache().lookup(name, addr)) {
+        complete(item.probe, item.jobs, nullptr);
+        return;
+    }
+
+    auto it = lane.targets.find(name);
+    if (it == lane.targets.end() || !same_address(lane.addrs[it->second], addr)) {
+        RttEstimator rtt = it == lane.targets.end() ? default_target_cache().rtt(name)
+                                                    : lane.prober->target_rtt(it->second);
+        sockaddr_storage sa;
+        socklen_t sa_len = addr.to_sockaddr(0, sa);
+        std::size_t target = lane.prober->add_target(name, sa, sa_len, rtt);
+        lane.names.push_back(name);
+        lane.addrs.push_back(addr);
+        it = lane.targets.insert(std::make_pair(name, target)).first;
+        it->second = target;
+    }
+    lane.prober->submit(it->second, probe.port, probe.protocol);
+    lane.in_flight.emplace(probe.key, std::move(item));
+}
+
+/**
+ * @brief Applies a probe's result, or reschedules a scheduled entry whose
+ *        probe could not run, and hands ad-hoc scans it completes back to
+ *        the server loop.
+ * @param r Result, or nullptr if the probe never ran.
+ */
+void ScanDaemon::complete(const Probe& probe, const std::vector<std::shared_ptr<Job>>& jobs,
+                          const ServiceResult* r) {
+    const uint64_t now = monotonic_ms();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (r) {
+        apply(probe, *r, now);
+    } else if (jobs.empty()) {
+        auto it = index_.find(probe.key);
+        if (it != index_.end() && entries_[it->second].scheduled) {
+            schedule(it->second, now);
+        }
+    }
+    for (const auto& job : jobs) {
+        if (--job->remaining == 0) {
+            finish_job(job);
+        }
+    }
+}
+
+/**
+ * @brief Scheduler refill: hands the prober the next few due entries, most
+ *        urgent first.
+ *
+ * Everything due is ranked once per batch of up to concurrency entries; the
+ * rest go back on the heap to be ranked again with whatever falls due
+ * meanwhile. due_ms 0 marks an entry as taken so duplicate heap items for it
+ * turn stale.
+ * @return false once nothing is due or the daemon is stopping.
+ */
+bool ScanDaemon::take_due(Lane& lane, std::deque<Due>& ready) {
+    std::vector<Probe> probes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) {
+            return false;
+        }
+        const uint64_t now = monotonic_ms();
+        if (ready.empty()) {
+            std::vector<Due> due;
+            while (!due_.empty() && due_.top().due_ms <= now + kBatchSlackMs) {
+                Due d = due_.top();
+                due_.pop();
+                if (!is_stale(d)) {
+                    entries_[d.entry].due_ms = 0;
+                    due.push_back(d);
+                }
+            }
+            std::stable_sort(due.begin(), due.end(), [](const Due& a, const Due& b) { return a.rank < b.rank; });
+            for (std::size_t i = 0; i < due.size(); ++i) {
+                if (i < config_.concurrency) {
+                    ready.push_back(due[i]);
+                } else {
+                    entries_[due[i].entry].due_ms = due[i].due_ms;
+                    due_.push(due[i]);
+                }
+            }
+            if (!ready.empty()) ++batches_;
+        }
+        while (!ready.empty() && probes.size() < kRefillChunk) {
+            Due d = ready.front();
+            ready.pop_front();
+            if (d.generation != generation_) {
+                continue; // Reloaded since; the new schedule has its own item.
+            }
+            const Entry& e = entries_[d.entry];
+            probes.push_back({key_of(e.host.name, e.port), e.host, e.port, protocol_for(e, now)});
+        }
+    }
+    for (const Probe& p : probes) {
+        submit_probe(lane, p, nullptr);
+    }
+    return !probes.empty();
+}
+
+/**
+ * @brief Jobs refill: runs every queued command, submitting the probes of
+ *        ad-hoc scans.
+ * @return false once the queue is empty or the daemon is stopping.
+ */
+bool ScanDaemon::take_jobs(Lane& lane) {
+    std::deque<std::shared_ptr<Job>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) {
+            return false;
+        }
+        jobs.swap(jobs_);
+    }
+    for (const auto& job : jobs) {
+        run_command(lane, job);
+    }
+    return !jobs.empty();
+}
+
+/**
+ * @brief Background rescans: waits until an entry is due, then runs the
+ *        scheduler's prober for as long as take_due() finds work.
+ */
+void ScanDaemon::scheduler_main() {
+    Lane lane;
+    std::deque<Due> ready;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        const uint64_t now = monotonic_ms();
+        while (!due_.empty() && is_stale(due_.top())) {
+            due_.pop();
+        }
+        if (due_.empty()) {
+            scheduler_cv_.wait(lock);
+            continue;
+        }
+        if (due_.top().due_ms > now) {
+            scheduler_cv_.wait_for(lock, std::chrono::milliseconds(due_.top().due_ms - now));
+            continue;
+        }
+        lock.unlock();
+        run_lane(lane, [&]() { return take_due(lane, ready); }, false);
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Client commands other than status run here, and ad-hoc scans on
+ *        their own prober so they never wait behind a background batch.
+ */
+void ScanDaemon::jobs_main() {
+    Lane lane;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        jobs_cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+            return;
+        }
+        lock.unlock();
+        run_lane(lane, [&]() { return take_jobs(lane); }, true);
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Hands a finished command back to the server loop, with the scanned
+ *        entries it asked for. Called with mutex_ held.
+ */
+void ScanDaemon::finish_job(const std::shared_ptr<Job>& job) {
+    for (const std::string& key : job->keys) {
+        auto it = index_.find(key);
+        if (it != index_.end() && entries_[it->second].scanned) {
+            job->entries.push_back(entries_[it->second]);
+        }
+    }
+    if (job->fd < 0) {
+        return;
+    }
+    finished_.push_back(job);
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        std::cerr << "Error: eventfd write failed - " << std::strerror(errno) << "\n";
+    }
+}
+
+/**
+ * @brief Runs a query, scan or reload on the jobs thread, where target files
+ *        and DNS lookups cannot stall the server loop. Called without
+ *        mutex_ held.
+ */
+void ScanDaemon::run_command(Lane& lane, const std::shared_ptr<Job>& job) {
+    std::istringstream words(job->line);
+    std::string command, targets_arg, ports_arg, age_arg, extra;
+    words >> command >> targets_arg >> ports_arg >> age_arg >> extra;
+    auto fail = [&](const std::string& message) {
+        job->notes.push_back("ERROR: " + message);
+        std::lock_guard<std::mutex> lock(mutex_);
+        finish_job(job);
+    };
+
+    if (command == "reload") {
+        std::string summary;
+        load(summary);
+        std::cerr << summary << "\n";
+        job->notes.push_back(summary);
+        std::lock_guard<std::mutex> lock(mutex_);
+        finish_job(job);
+        return;
+    }
+
+    std::vector<HostEntry> hosts;
+    std::vector<int> ports;
+    if (!targets_arg.empty() && !parse_targets(targets_arg, hosts)) {
+        fail("invalid targets '" + targets_arg + "'");
+        return;
+    }
+    if (!ports_arg.empty() && !parse_ports(ports_arg, ports)) {
+        fail("invalid ports '" + ports_arg + "'");
+        return;
+    }
+
+    if (command == "query") {
+        if (!age_arg.empty()) {
+            fail("usage: query [TARGETS [PORTS]]");
+            return;
+        }
+        std::unordered_set<std::string> names;
+        for (const HostEntry& host : hosts) names.insert(host.name);
+        std::unordered_set<int> port_set(ports.begin(), ports.end());
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const Entry& e : entries_) {
+            if (e.scanned && (names.empty() || names.count(e.host.name)) &&
+                (port_set.empty() || port_set.count(e.port))) {
+                job->entries.push_back(e);
+            }
+        }
+        finish_job(job);
+        return;
+    }
+
+    long max_age = -1;
+    if (hosts.empty() || ports.empty() || !extra.empty() ||
+        (!age_arg.empty() && !parse_long(age_arg, 0, INT_MAX, max_age))) {
+        fail("usage: scan TARGETS PORTS [MAX_AGE]");
+        return;
+    }
+    if (hosts.size() * ports.size() > kMaxAdhocProbes) {
+        fail("scan of " + std::to_string(hosts.size() * ports.size()) + " probes exceeds the limit of " +
+             std::to_string(kMaxAdhocProbes));
+        return;
+    }
+
+    std::vector<Probe> probes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const uint64_t now = monotonic_ms();
+        const uint64_t max_age_ms = static_cast<uint64_t>(max_age < 0 ? config_.max_age_s : max_age) * 1000;
+        for (const HostEntry& host : hosts) {
+            for (int port : ports) {
+                std::string key = key_of(host.name, port);
+                auto it = index_.find(key);
+                const Entry* e = it != index_.end() ? &entries_[it->second] : nullptr;
+                ServiceProtocol protocol = service_protocol_for(e ? e->protocol : label_for(port));
+                bool fresh = e && e->scanned && now - e->scanned_ms <= max_age_ms &&
+                             (protocol != ServiceProtocol::TLS || e->status != PortStatus::OPEN ||
+                              now - e->cert_ms <= max_age_ms);
+                if (!fresh) {
+                    probes.push_back({key, host, port, protocol});
+                }
+                job->keys.push_back(std::move(key));
+            }
+        }
+        if (probes.empty()) {
+            ++cache_hits_;
+            finish_job(job);
+            return;
+        }
+        ++adhoc_jobs_;
+        job->remaining = probes.size();
+    }
+    for (const Probe& p : probes) {
+        submit_probe(lane, p, job);
+    }
+}
+
+/**
+ * @brief Renders a reply and sends what the socket takes right away; the
+ *        server loop sends the rest. Takes ownership of fd.
+ *
+ * Binary records cannot carry text, so replies with notes (status, reload
+ * and errors) are always written as text.
+ */
+void ScanDaemon::reply(int fd, const std::vector<Entry>& entries, const std::vector<std::string>& notes) {
+    Client c{fd, std::string(), std::vector<char>(), 0, monotonic_ms()};
+    std::unique_ptr<ResultSink> sink = make_result_sink(notes.empty() ? format_ : "text", c.out);
+    for (const std::string& note : notes) {
+        sink->note(note);
+    }
+    for (const Entry& e : entries) {
+        if (service_protocol_for(e.protocol) == ServiceProtocol::TLS && e.cert.valid()) {
+            sink->cert_result(e.host, e.port, e.protocol, e.cert);
+        } else if (!e.protocol.empty()) {
+            sink->service_result(e.host, e.port, e.protocol, e.status, e.service);
+        } else {
+            sink->port_result(e.host, e.port, e.protocol, e.status);
+        }
+    }
+    sink->flush();
+    if (send_reply(c)) {
+        clients_.push_back(std::move(c));
+    }
+}
+
+/**
+ * @brief Sends as much of a client's reply as the socket takes without blocking.
+ * @return true while part of the reply is unsent; otherwise the client is closed.
+ */
+bool ScanDaemon::send_reply(Client& c) {
+    while (c.sent < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            break;
+        }
+        c.sent += static_cast<std::size_t>(n);
+        c.active_ms = monotonic_ms();
+    }
+    close(c.fd);
+    return false;
+}
+
+/**
+ * @brief Queues a command for the jobs thread; fd -1 runs it without a reply.
+ */
+void ScanDaemon::queue_job(int fd, const std::string& line) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->fd = fd;
+    job->line = line;
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(job);
+    jobs_cv_.notify_one();
+}
+
+/**
+ * @brief Answers status and unknown commands from the server loop and queues
+ *        the rest for the jobs thread; takes ownership of fd.
+ */
+void ScanDaemon::handle(int fd, const std::string& line) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if (command == "status") {
+        const uint64_t now = monotonic_ms();
+        std::vector<std::string> notes;
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::size_t scanned = 0, open = 0, due = 0, expiring = 0;
+        for (const Entry& e : entries_) {
+            if (!e.scheduled) continue;
+            if (e.scanned) ++scanned;
+            if (e.scanned && e.status == PortStatus::OPEN) ++open;
+            if (e.due_ms <= now) ++due;
+            if (near_expiry(e)) ++expiring;
+        }
+        notes.push_back("Config: " + config_path_);
+        notes.push_back("Targets: " + std::to_string(host_count_) + " hosts x " +
+                        std::to_string(config_.ports.size()) + " ports, " + std::to_string(scanned) +
+                        " scanned, " + std::to_string(open) + " open, " + std::to_string(expiring) +
+                        " certificates near expiry");
+        notes.push_back("Schedule: " + std::to_string(due) + " due or in progress, " +
+                        std::to_string(batches_) + " batches, " + std::to_string(probes_) + " probes");
+        notes.push_back("Ad-hoc: " + std::to_string(adhoc_jobs_) + " scans probed, " +
+                        std::to_string(cache_hits_) + " answered from cache, " +
+                        std::to_string(entries_.size() - scheduled_count_) + " extra results cached, " +
+                        std::to_string(jobs_.size()) + " queued");
+        notes.push_back("Uptime: " + std::to_string((now - started_ms_) / 1000) + " s");
+        lock.unlock();
+        reply(fd, std::vector<Entry>(), notes);
+        return;
+    }
+    if (command != "query" && command != "scan" && command != "reload") {
+        reply(fd, std::vector<Entry>(),
+              {"ERROR: unknown command '" + command + "' (expected query, scan, status or reload)"});
+        return;
+    }
+    queue_job(fd, line);
+}
+
+bool ScanDaemon::run() {
+    bool ok = true;
+    while (!g_stop) {
+        std::vector<struct pollfd> pfds;
+        pfds.push_back({wake_fd_, POLLIN, 0});
+        pfds.push_back({listen_fd_, POLLIN, 0});
+        for (const Client& c : clients_) {
+            pfds.push_back({c.fd, static_cast<short>(c.out.empty() ? POLLIN : POLLOUT), 0});
+        }
+        if (poll(pfds.data(), pfds.size(), 1000) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: poll() failed - " << std::strerror(errno) << "\n";
+            ok = false;
+            break;
+        }
+        if (g_stop) {
+            break;
+        }
+        if (pfds[0].revents) {
+            uint64_t value;
+            if (read(wake_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                std::cerr << "Error: eventfd read failed - " << std::strerror(errno) << "\n";
+            }
+        }
+        if (g_reload) {
+            g_reload = 0;
+            queue_job(-1, "reload");
+        }
+
+        // pfds[2 + i] belongs to clients_[i] for i < polled; replies below
+        // append clients that were not polled yet.
+        const std::size_t polled = clients_.size();
+        std::vector<std::shared_ptr<Job>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished.swap(finished_);
+        }
+        for (const auto& job : finished) {
+            reply(job->fd, job->entries, job->notes);
+        }
+
+        const uint64_t now = monotonic_ms();
+        for (std::size_t i = clients_.size(); i-- > 0;) {
+            Client& c = clients_[i];
+            const short revents = i < polled ? pfds[2 + i].revents : 0;
+            if (!c.out.empty()) {
+                bool pending = revents ? send_reply(c) : now - c.active_ms <= kClientTimeoutMs;
+                if (!pending) {
+                    if (!revents) close(c.fd);
+                    clients_.erase(clients_.begin() + static_cast<std::ptrdiff_t>(i));
+                }
+                continue;
+            }
+            bool complete = false;
+            bool drop = false;
+            if (revents) {
+                char buf[1024];
+                ssize_t n = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n > 0) {
+                    c.line.append(buf, static_cast<std::size_t>(n));
+                    complete = c.line.find('\n') != std::string::npos;
+                    drop = !complete && c.line.size() > kMaxCommandLength;
+                } else if (n == 0) {
+                    complete = !c.line.empty();
+                    drop = !complete;
+                } else {
+                    drop = errno != EAGAIN && errno != EINTR;
+                }
+            } else {
+                drop = now - c.active_ms > kClientTimeoutMs;
+            }
+            if (complete) {
+                std::string line = c.line.substr(0, c.line.find('\n'));
+                int fd = c.fd;
+                clients_.erase(clients_.begin() + static_cast<std::ptrdiff_t>(i));
+                handle(fd, line);
+            } else if (drop) {
+                close(c.fd);
+                clients_.erase(clients_.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+
+        if (pfds[1].revents) {
+            for (;;) {
+                int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    break;
+                }
+                clients_.push_back({fd, std::string(), std::vector<char>(), 0, now});
+            }
+        }
+    }
+    shutdown();
+    return ok;
+}
+
+bool daemon_query(const std::string& socket_path, const std::string& command) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path '" << socket_path << "' is too long.\n";
+        return false;
+    }
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "Error: cannot connect to daemon at '" << socket_path << "' - " << std::strerror(errno)
+                  << "\n";
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    std::string line = command + "\n";
+    bool ok = send(fd, line.data(), line.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(line.size());
+    char buf[65536];
+    ssize_t n;
+    while (ok && (n = recv(fd, buf, sizeof(buf), 0)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(STDOUT_FILENO, buf + off, static_cast<std::size_t>(n - off));
+            if (w <= 0) {
+                ok = false;
+                break;
+            }
+            off += w;
+        }
+    }
+    if (!ok) {
+        std::cerr << "Error: lost connection to daemon at '" << socket_path << "' - " << std::strerror(errno)
+                  << "\n";
+    }
+    close(fd);
+    return ok;
+}
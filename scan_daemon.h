@@ -0,0 +1,208 @@
+#pragma once
+#include "daemon_config.h"
+#include "cert_utils.h"
+#include "service_probe.h"
+#include "target_spec.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Long-running scanner that keeps results fresh and answers queries.
+ *
+ * Every configured host x port is rescanned on its own schedule: open ports
+ * every open_interval, closed and filtered ones every interval. HTTPS ports
+ * get a TLS handshake every cert_interval, or on every rescan once their
+ * certificate is within expiry_days of expiring. When more probes are due
+ * than fit in one batch, near-expiry certificates go first, then open ports.
+ * Each scan thread keeps one ServiceProber and feeds it through its refill
+ * callback, so targets keep their RTT estimates and, with the resolver cache,
+ * the shared TLS context and the certificate table,
+ * stay warm between rescans instead of being rebuilt per batch.
+ *
+ * Clients talk to the daemon over a Unix-domain socket, one command line per
+ * connection; the reply is written in the daemon's output format and the
+ * connection is closed. Replies carrying text (status, reload, errors) are
+ * always plain text, since binary records have no room for it:
+ *
+ *     query [TARGETS [PORTS]]       cached results, answered without probing
+ *     scan TARGETS PORTS [MAX_AGE]  results no older than MAX_AGE seconds
+ *                                   (default: max_age); stale ones are probed
+ *                                   on a dedicated thread, ahead of rescans
+ *     status                        schedule and cache counters
+ *     reload                        re-read the config file (also on SIGHUP)
+ *
+ * PORTS is a comma-separated list of ports and ranges, e.g. "22,443,8000-8010".
+ * Everything but status runs on the jobs thread, so target files and DNS
+ * lookups never stall the socket loop, which also writes replies without
+ * blocking.
+ * Results for pairs that are not configured are cached for max_age only,
+ * and at most 262144 of them are kept.
+ * The daemon stops on SIGINT or SIGTERM.
+ */
+class ScanDaemon {
+public:
+    /**
+     * @param config_path Config file (see daemon_config.h), re-read on reload.
+     * @param format Reply format: text, jsonl or binary.
+     */
+    ScanDaemon(const std::string& config_path, const std::string& format);
+    ~ScanDaemon();
+
+    ScanDaemon(const ScanDaemon&) = delete;
+    ScanDaemon& operator=(const ScanDaemon&) = delete;
+
+    /**
+     * @brief Loads the config, binds the socket and starts the scan threads.
+     * @return false on a config or socket error (an error is printed).
+     */
+    bool start();
+
+    /**
+     * @brief Serves clients until SIGINT or SIGTERM, then stops the scan threads.
+     * @return false if the event loop failed.
+     */
+    bool run();
+
+private:
+    /// Result state for one host x port.
+    struct Entry {
+        HostEntry host;
+        int port = 0;
+        std::string protocol;    ///< Configured label, e.g. "HTTPS"; empty for connect-only.
+        bool scheduled = false;  ///< Rescanned by the scheduler (false for ad-hoc-only entries).
+        bool scanned = false;
+        PortStatus status = PortStatus::CLOSED;
+        std::string service;
+        CertInfo cert;
+        uint64_t scanned_ms = 0; ///< Monotonic time of the last probe.
+        uint64_t cert_ms = 0;    ///< Monotonic time of the last TLS handshake.
+        uint64_t due_ms = 0;     ///< Next scheduled rescan.
+    };
+
+    /// Heap item; stale once the entry was rescheduled or the config reloaded.
+    struct Due {
+        uint64_t due_ms;
+        unsigned rank;           ///< 0 near-expiry certificate, 1 open, 2 other.
+        std::size_t entry;
+        uint64_t generation;
+        bool operator>(const Due& o) const { return due_ms != o.due_ms ? due_ms > o.due_ms : rank > o.rank; }
+    };
+
+    struct Probe {
+        std::string key;
+        HostEntry host;
+        int port;
+        ServiceProtocol protocol;
+    };
+
+    /// A client command for the jobs thread, and then the ad-hoc probes it waits for.
+    struct Job {
+        int fd;                          ///< Client; -1 for a reload requested by SIGHUP.
+        std::string line;                ///< Command as received.
+        std::vector<std::string> keys;   ///< Entries to reply with, in request order.
+        std::vector<Entry> entries;      ///< Reply, filled in when the job finishes.
+        std::vector<std::string> notes;  ///< Reply lines such as errors, sent instead of entries.
+        std::size_t remaining = 0;       ///< Probes not yet completed; guarded by mutex_.
+    };
+
+    /// A submitted probe and the ad-hoc scans waiting for it.
+    struct InFlight {
+        Probe probe;
+        std::vector<std::shared_ptr<Job>> jobs;
+    };
+
+    /// A scan thread's prober, kept across batches so targets keep their RTT estimates.
+    struct Lane {
+        std::unique_ptr<ServiceProber> prober;
+        uint32_t timeout_ms = 0;
+        std::size_t concurrency = 0;
+        std::unordered_map<std::string, std::size_t> targets; ///< Host name -> current target index.
+        std::vector<std::string> names;                       ///< Target index -> host name.
+        std::vector<TargetAddress> addrs;                     ///< Target index -> address it was added with.
+        std::unordered_map<std::string, InFlight> in_flight;  ///< "host port" -> probe awaiting its result.
+    };
+
+    /// A connection being read from or, once out holds a reply, written to.
+    struct Client {
+        int fd;
+        std::string line;       ///< Command bytes received so far.
+        std::vector<char> out;  ///< Rendered reply; empty while reading.
+        std::size_t sent;       ///< Bytes of out already sent.
+        uint64_t active_ms;     ///< Accept time, then time of the last write progress.
+    };
+
+    bool load(std::string& summary);
+    bool bind_socket();
+    void shutdown();
+    void scheduler_main();
+    void jobs_main();
+    void run_lane(Lane& lane, const std::function<bool()>& refill, bool eager);
+    void submit_probe(Lane& lane, const Probe& probe, const std::shared_ptr<Job>& job);
+    void complete(const Probe& probe, const std::vector<std::shared_ptr<Job>>& jobs, const ServiceResult* r);
+    bool take_due(Lane& lane, std::deque<Due>& ready);
+    bool take_jobs(Lane& lane);
+    void run_command(Lane& lane, const std::shared_ptr<Job>& job);
+    void finish_job(const std::shared_ptr<Job>& job);
+    void queue_job(int fd, const std::string& line);
+    bool is_stale(const Due& d) const;
+    void apply(const Probe& probe, const ServiceResult& r, uint64_t now);
+    void schedule(std::size_t index, uint64_t now);
+    unsigned rank_of(const Entry& e) const;
+    bool near_expiry(const Entry& e) const;
+    ServiceProtocol protocol_for(const Entry& e, uint64_t now) const;
+    std::size_t entry_for(const std::string& key, const HostEntry& host, int port, uint64_t now);
+    void prune_adhoc(uint64_t now);
+    void handle(int fd, const std::string& line);
+    void reply(int fd, const std::vector<Entry>& entries, const std::vector<std::string>& notes);
+    bool send_reply(Client& c);
+    std::string label_for(int port) const;
+
+    std::string config_path_;
+    std::string format_;
+    std::string socket_path_;
+    int listen_fd_;
+    int wake_fd_;
+    uint64_t started_ms_;
+
+    // Everything below is guarded by mutex_.
+    std::mutex mutex_;
+    std::condition_variable scheduler_cv_;
+    std::condition_variable jobs_cv_;
+    bool stop_;
+    DaemonConfig config_;
+    std::size_t host_count_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, std::size_t> index_;  ///< "host port" -> entries_ index.
+    std::size_t scheduled_count_;  ///< entries_ starts with the configured entries; ad-hoc-only ones follow.
+    std::size_t prune_at_;         ///< Ad-hoc-only entry count that triggers prune_adhoc().
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_;
+    uint64_t generation_;
+    std::deque<std::shared_ptr<Job>> jobs_;
+    std::vector<std::shared_ptr<Job>> finished_;
+    uint64_t batches_;
+    uint64_t probes_;
+    uint64_t adhoc_jobs_;
+    uint64_t cache_hits_;
+
+    std::vector<Client> clients_;
+    std::thread scheduler_;
+    std::thread jobs_thread_;
+};
+
+/**
+ * @brief Sends one command to a running daemon and copies the reply to stdout.
+ * @param socket_path The daemon's socket.
+ * @param command Command line, e.g. "scan 10.0.0.5 443".
+ * @return false if the daemon cannot be reached (an error is printed).
+ */
+bool daemon_query(const std::string& socket_path, const std::string& command);
@@ -0,0 +1,85 @@
+#include "scan_diff.h"
+#include <ctime>
+
+ScanDiff::ScanDiff(int expiry_days) : expiry_days_(expiry_days) {}
+
+bool ScanDiff::load(const std::string& path) {
+    by_name_.clear();
+    if (!previous_.open(path)) {
+        return false;
+    }
+    // Index names once; the mapped store's own find_host() is a linear scan.
+    for (std::size_t h = 0; h < previous_.host_count(); ++h) {
+        by_name_.emplace(previous_.host_name(h), h);
+    }
+    return true;
+}
+
+bool ScanDiff::find(const std::string& host, std::size_t& index) const {
+    auto it = by_name_.find(host);
+    if (it == by_name_.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+PortState ScanDiff::previous(const std::string& host, int port) const {
+    std::size_t index;
+    return find(host, index) ? previous_.state(index, port) : PortState::NOT_SCANNED;
+}
+
+std::vector<int> ScanDiff::previously_open(const std::string& host, int first, int last) const {
+    std::vector<int> ports;
+    std::size_t index;
+    if (!find(host, index)) {
+        return ports;
+    }
+    for (int port : previous_.ports_with(index, PortState::OPEN)) {
+        if (port >= first && port <= last) {
+            ports.push_back(port);
+        }
+    }
+    return ports;
+}
+
+bool ScanDiff::port_changed(const std::string& host, int port, PortStatus status, PortState& previous_state) const {
+    previous_state = previous(host, port);
+    return (status == PortStatus::OPEN) != (previous_state == PortState::OPEN);
+}
+
+bool ScanDiff::cert_changed(const std::string& host, int port, const CertInfo& cert, std::string& reason) const {
+    reason.clear();
+    std::size_t index;
+    CertInfo before;
+    if (!find(host, index) || !previous_.cert(index, port, before) || !before.valid()) {
+        before = CertInfo();
+    }
+    if (!cert.valid()) {
+        if (before.valid()) reason = "MISSING";
+        return !reason.empty();
+    }
+    if (before.valid()) {
+        // Names and expiry survive a reissue or rekey; the fingerprint does not.
+        const CertRecord& a = *before.record();
+        const CertRecord& b = *cert.record();
+        bool differs = a.has_fingerprint() && b.has_fingerprint()
+            ? a.fingerprint() != b.fingerprint()
+            : a.subject() != b.subject() || a.issuer() != b.issuer() || a.not_after() != b.not_after();
+        if (differs) reason = "CHANGED";
+    }
+    time_t expires = cert.not_after_time();
+    if (expires != 0) {
+        double seconds_left = std::difftime(expires, std::time(nullptr));
+        std::string expiry;
+        if (seconds_left <= 0) {
+            expiry = "EXPIRED";
+        } else if (seconds_left < static_cast<double>(expiry_days_) * 86400.0) {
+            expiry = "EXPIRES IN " + std::to_string(static_cast<long>(seconds_left / 86400.0)) + " DAYS";
+        }
+        if (!expiry.empty()) {
+            reason += reason.empty() ? expiry : ", " + expiry;
+        }
+    }
+    return !reason.empty();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "cert_utils.h"
+#include "result_store.h"
+#include "target_spec.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Compares this run's results against a store saved by an earlier run.
+ *
+ * Only transitions into or out of OPEN count as port changes; a port that
+ * went from CLOSED to FILTERED is not reported. A certificate is reported when
+ * its SHA-256 fingerprint differs from the previous run's (subject, issuer and
+ * expiry for stores written without fingerprints), when a certificate seen in
+ * the previous run can no longer be retrieved, or when it expires within the
+ * configured number of days.
+ */
+class ScanDiff {
+public:
+    /**
+     * @param expiry_days Report certificates expiring within this many days.
+     */
+    explicit ScanDiff(int expiry_days = 30);
+
+    /**
+     * @brief Loads the previous run.
+     * @param path File written by ResultStore::save() (--store).
+     * @return false if the file cannot be mapped (an error is printed).
+     */
+    bool load(const std::string& path);
+
+    /** @brief State of a port in the previous run; NOT_SCANNED for unknown hosts. */
+    PortState previous(const std::string& host, int port) const;
+
+    /**
+     * @brief Ports that were OPEN on a host in the previous run.
+     * @param host Host name.
+     * @param first Lowest port of interest.
+     * @param last Highest port of interest.
+     */
+    std::vector<int> previously_open(const std::string& host, int first, int last) const;
+
+    /**
+     * @brief Checks a port result against the previous run.
+     * @param previous Output: the previous state.
+     * @return true if the port opened or stopped being open.
+     */
+    bool port_changed(const std::string& host, int port, PortStatus status, PortState& previous) const;
+
+    /**
+     * @brief Checks this run's handshake result against the previous run.
+     * @param cert Certificate retrieved, or an invalid CertInfo if the handshake failed.
+     * @param reason Output: "MISSING", or "CHANGED", "EXPIRED" or "EXPIRES IN N DAYS", comma-separated.
+     * @return true if the certificate should be reported.
+     */
+    bool cert_changed(const std::string& host, int port, const CertInfo& cert, std::string& reason) const;
+
+private:
+    bool find(const std::string& host, std::size_t& index) const;
+
+    int expiry_days_;
+    MappedResultStore previous_;
+    std::unordered_map<std::string, std::size_t> by_name_;
+};
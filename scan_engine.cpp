@@ -0,0 +1,598 @@
+#include "scan_engine.h"
+#include "metrics.h"
+#include "io_ring.h"
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cstring>
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+
+/**
+ * @brief Raises RLIMIT_NOFILE to its hard limit and returns how many sockets
+ *        may be kept open at once.
+ * @param wanted Requested concurrency.
+ * @return Concurrency clamped to the descriptor limit, never less than 1.
+ */
+std::size_t clamp_to_fd_limit(std::size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        return wanted;
+    }
+    if (rl.rlim_cur < rl.rlim_max && rl.rlim_cur < wanted + 64) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur == RLIM_INFINITY) {
+        return wanted;
+    }
+    // Leave headroom for stdio, the epoll fd and anything else the process holds.
+    std::size_t limit = rl.rlim_cur > 64 ? static_cast<std::size_t>(rl.rlim_cur - 64) : 1;
+    return wanted < limit ? wanted : limit;
+}
+
+/**
+ * @brief Packs a probe slot and its generation into epoll user data.
+ */
+static uint64_t pack_token(uint32_t slot, uint32_t gen) {
+    return (static_cast<uint64_t>(gen) << 32) | slot;
+}
+
+/// io_uring user data reserves its top three bits for IoRing::Op.
+static const uint32_t kRingGenMask = 0x1fffffffu;
+
+ScanEngine::ScanEngine(const ScanEngineOptions& options)
+    : options_(options),
+      epfd_(epoll_create1(EPOLL_CLOEXEC)),
+      window_(0),
+      in_flight_(0),
+      wheel_(options.tick_ms, 4096),
+      limiter_(options.rate_limit, options.rate_limit / 10.0),
+      cwnd_(1, 1, 1),
+      hook_(nullptr) {
+    if (epfd_ < 0) {
+        std::cerr << "Error: epoll_create1() failed - " << std::strerror(errno) << "\n";
+    }
+    if (options_.max_in_flight == 0) options_.max_in_flight = 1;
+    window_ = clamp_to_fd_limit(options_.max_in_flight);
+    cwnd_ = CongestionWindow(options_.initial_window, 1, window_);
+    probes_.resize(window_);
+    free_slots_.reserve(window_);
+    for (std::size_t i = window_; i > 0; --i) {
+        free_slots_.push_back(static_cast<uint32_t>(i - 1));
+    }
+    if (options_.io_uring) {
+        ring_.reset(new IoRing());
+        std::string error;
+        if (ring_->init(window_, error)) {
+            ring_addrs_.resize(window_);
+        } else {
+            // Sharded scans build one engine per worker; explain the fallback once.
+            static std::atomic<bool> warned(false);
+            if (!warned.exchange(true)) {
+                std::cerr << "Note: io_uring unavailable (" << error << "); using epoll.\n";
+            }
+            ring_.reset();
+        }
+    }
+}
+
+ScanEngine::~ScanEngine() {
+    for (auto& p : probes_) {
+        if (p.fd >= 0) close(p.fd);
+    }
+    if (epfd_ >= 0) close(epfd_);
+}
+
+std::size_t ScanEngine::add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                                   const RttEstimator& rtt) {
+    targets_.push_back(Target{host, addr, addr_len, rtt});
+    return targets_.size() - 1;
+}
+
+void ScanEngine::submit(std::size_t target, int port, uint64_t tag) {
+    queue_.push_back(Pending{target, port, tag});
+}
+
+/**
+ * @brief Opens a non-blocking socket and starts a connect for one probe.
+ *
+ * The connect is waited for on epoll, or with a ConnectHook under io_uring,
+ * through a poll on the ring.
+ * @return IN_FLIGHT if the connect is pending, DONE if a result was already
+ *         emitted, RETRY if the probe should be requeued (descriptor or
+ *         ephemeral port exhaustion), FAILED if the ring failed.
+ */
+ScanEngine::LaunchResult ScanEngine::launch(const Pending& p, const ResultCallback& on_result) {
+    const Target& t = targets_[p.target];
+    uint64_t socket_start = monotonic_us();
+    int sock = socket(t.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    uint64_t connect_start = monotonic_us();
+    metrics_record(MetricPhase::SOCKET_CREATE, connect_start - socket_start);
+    if (sock < 0) {
+        metrics_count_errno(errno);
+        if ((errno == EMFILE || errno == ENFILE || errno == ENOBUFS) && in_flight_ > 0) {
+            cwnd_.on_loss(monotonic_ms(), 0);
+            return LaunchResult::RETRY;
+        }
+        std::cerr << "Error: socket() failed for " << t.host << ":" << p.port
+                  << " - " << std::strerror(errno) << "\n";
+        metrics_count_status(PortStatus::CLOSED);
+        on_result(ScanResult{p.target, p.port, PortStatus::CLOSED, 0, p.tag});
+        return LaunchResult::DONE;
+    }
+
+    sockaddr_storage addr = t.addr;
+    if (addr.ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port = htons(static_cast<uint16_t>(p.port));
+    } else {
+        reinterpret_cast<sockaddr_in*>(&addr)->sin_port = htons(static_cast<uint16_t>(p.port));
+    }
+
+    uint64_t start = monotonic_ms();
+    int res = connect(sock, reinterpret_cast<sockaddr*>(&addr), t.addr_len);
+    // With a hook, an immediate connect still goes through the loop: epoll
+    // reports it writable at once and the hook's exchange starts there.
+    if (res == 0 && !hook_) {
+        close(sock);
+        metrics_record(MetricPhase::CONNECT, monotonic_us() - connect_start);
+        metrics_count_status(PortStatus::OPEN);
+        on_result(ScanResult{p.target, p.port, PortStatus::OPEN, 0, p.tag});
+        return LaunchResult::DONE;
+    }
+    if (res != 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(sock);
+        metrics_count_errno(err);
+        if ((err == EADDRNOTAVAIL || err == ENOBUFS) && in_flight_ > 0) {
+            cwnd_.on_loss(monotonic_ms(), 0);
+            return LaunchResult::RETRY;
+        }
+        metrics_record(MetricPhase::CONNECT, monotonic_us() - connect_start);
+        metrics_count_status(PortStatus::CLOSED);
+        on_result(ScanResult{p.target, p.port, PortStatus::CLOSED, 0, p.tag});
+        return LaunchResult::DONE;
+    }
+
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    Probe& probe = probes_[slot];
+    probe.fd = sock;
+    probe.target = p.target;
+    probe.port = p.port;
+    probe.tag = p.tag;
+    probe.start_ms = start;
+    probe.start_us = connect_start;
+    ++probe.gen;
+
+    uint32_t deadline = options_.adaptive_timeout
+        ? t.rtt.timeout_ms(options_.timeout_ms, options_.min_timeout_ms, options_.max_timeout_ms)
+        : options_.timeout_ms;
+    if (ring_) {
+        if (!ring_->queue_poll(sock, POLLOUT, pack_token(slot, probe.gen & kRingGenMask), deadline)) {
+            close(sock);
+            probe.fd = -1;
+            free_slots_.push_back(slot);
+            return LaunchResult::FAILED;
+        }
+        ++in_flight_;
+        return LaunchResult::IN_FLIGHT;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT | EPOLLERR | EPOLLHUP;
+    ev.data.u64 = pack_token(slot, probe.gen);
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, sock, &ev) < 0) {
+        std::cerr << "Error: epoll_ctl() failed for " << t.host << ":" << p.port
+                  << " - " << std::strerror(errno) << "\n";
+        close(sock);
+        probe.fd = -1;
+        free_slots_.push_back(slot);
+        metrics_count_status(PortStatus::CLOSED);
+        on_result(ScanResult{p.target, p.port, PortStatus::CLOSED, 0, p.tag});
+        return LaunchResult::DONE;
+    }
+
+    wheel_.schedule(start, deadline, slot, probe.gen);
+    ++in_flight_;
+    return LaunchResult::IN_FLIGHT;
+}
+
+/**
+ * @brief Feeds a connect outcome to the target's RTT estimate, the congestion
+ *        window and the metrics, and records the round trip on the probe.
+ */
+void ScanEngine::account(uint32_t slot, PortStatus status, uint64_t now) {
+    Probe& probe = probes_[slot];
+    probe.rtt_ms = static_cast<uint32_t>(now - probe.start_ms);
+    if (status != PortStatus::FILTERED) {
+        // SYN-ACK and RST both measure a full round trip. A sample far above
+        // the smoothed RTT means queues are building somewhere: back off.
+        RttEstimator& rtt = targets_[probe.target].rtt;
+        if (rtt.samples() >= 4 && probe.rtt_ms > 2.0 * rtt.srtt_ms() + options_.tick_ms) {
+            cwnd_.on_loss(now, static_cast<uint32_t>(rtt.srtt_ms()) + options_.tick_ms);
+        } else {
+            cwnd_.on_response();
+        }
+        rtt.sample(probe.rtt_ms);
+    } else {
+        // Silence is the normal answer from a filtered port, not a congestion signal.
+        cwnd_.on_response();
+    }
+    metrics_record(MetricPhase::CONNECT, monotonic_us() - probe.start_us);
+    metrics_count_status(status);
+}
+
+/**
+ * @brief Closes a probe's socket and returns its slot to the free list.
+ */
+void ScanEngine::release(uint32_t slot) {
+    Probe& probe = probes_[slot];
+    if (probe.fd >= 0) {
+        close(probe.fd);
+        probe.fd = -1;
+    } else if (ring_) {
+        ring_->queue_close(slot, pack_token(slot, probe.gen & kRingGenMask));
+    }
+    probe.session = false;
+    ++probe.gen; // invalidates the pending timer entry
+    free_slots_.push_back(slot);
+    --in_flight_;
+}
+
+/**
+ * @brief Closes a probe's socket, releases its slot and emits the result.
+ */
+void ScanEngine::finish(uint32_t slot, PortStatus status, const ResultCallback& on_result) {
+    Probe& probe = probes_[slot];
+    account(slot, status, monotonic_ms());
+    ScanResult result{probe.target, probe.port, status, probe.rtt_ms, probe.tag};
+    release(slot);
+    on_result(result);
+}
+
+/**
+ * @brief Hands a freshly connected probe to the ConnectHook.
+ * @return false if the ring failed.
+ */
+bool ScanEngine::begin_session(uint32_t slot, const ResultCallback& on_result) {
+    Probe& probe = probes_[slot];
+    uint64_t now = monotonic_ms();
+    account(slot, PortStatus::OPEN, now);
+    probe.session = true;
+    ++probe.gen; // retires the connect's deadline
+    if (!ring_) {
+        wheel_.schedule(now, session_remaining_ms(probe, now), slot, probe.gen);
+    }
+    uint32_t events = hook_->start(slot, probe.fd, probe.target, probe.port, probe.tag);
+    return continue_session(slot, events, on_result);
+}
+
+/**
+ * @brief Waits for the events the hook asked for, or ends the session on 0.
+ * @return false if the ring failed.
+ */
+bool ScanEngine::continue_session(uint32_t slot, uint32_t events, const ResultCallback& on_result) {
+    if (events == 0) {
+        end_session(slot, on_result);
+        return true;
+    }
+    Probe& probe = probes_[slot];
+    if (ring_) {
+        return ring_->queue_poll(probe.fd, events, pack_token(slot, probe.gen & kRingGenMask),
+                                 session_remaining_ms(probe, monotonic_ms()));
+    }
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = pack_token(slot, probe.gen);
+    if (epoll_ctl(epfd_, EPOLL_CTL_MOD, probe.fd, &ev) < 0) {
+        std::cerr << "Error: epoll_ctl() failed - " << std::strerror(errno) << "\n";
+        end_session(slot, on_result);
+    }
+    return true;
+}
+
+/**
+ * @brief Ends a hook's session and reports the probe OPEN; the hook sees
+ *        finish() right before the result callback.
+ */
+void ScanEngine::end_session(uint32_t slot, const ResultCallback& on_result) {
+    Probe& probe = probes_[slot];
+    ScanResult result{probe.target, probe.port, PortStatus::OPEN, probe.rtt_ms, probe.tag};
+    hook_->finish(slot);
+    release(slot);
+    on_result(result);
+}
+
+/**
+ * @brief Time left for a session: whatever the connect left of timeout_ms, at least 1 ms.
+ */
+uint32_t ScanEngine::session_remaining_ms(const Probe& probe, uint64_t now) const {
+    uint64_t elapsed = now - probe.start_ms;
+    return elapsed + 1 < options_.timeout_ms ? static_cast<uint32_t>(options_.timeout_ms - elapsed) : 1;
+}
+
+bool ScanEngine::run(const ResultCallback& on_result, const RefillCallback& refill) {
+    return ring_ ? run_uring(on_result, refill) : run_epoll(on_result, refill);
+}
+
+/**
+ * @brief Queues one probe's socket/connect/timeout chain on the ring.
+ * @return false if the ring failed.
+ */
+bool ScanEngine::launch_uring(const Pending& p) {
+    const Target& t = targets_[p.target];
+    uint32_t slot = free_slots_.back();
+    sockaddr_storage& addr = ring_addrs_[slot];
+    addr = t.addr;
+    if (addr.ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port = htons(static_cast<uint16_t>(p.port));
+    } else {
+        reinterpret_cast<sockaddr_in*>(&addr)->sin_port = htons(static_cast<uint16_t>(p.port));
+    }
+
+    Probe& probe = probes_[slot];
+    probe.target = p.target;
+    probe.port = p.port;
+    probe.tag = p.tag;
+    probe.start_ms = monotonic_ms();
+    probe.start_us = monotonic_us();
+    probe.socket_error = 0;
+    ++probe.gen;
+
+    uint32_t deadline = options_.adaptive_timeout
+        ? t.rtt.timeout_ms(options_.timeout_ms, options_.min_timeout_ms, options_.max_timeout_ms)
+        : options_.timeout_ms;
+    if (!ring_->queue_connect(slot, pack_token(slot, probe.gen & kRingGenMask), &addr, t.addr_len, deadline)) {
+        return false;
+    }
+    free_slots_.pop_back();
+    ++in_flight_;
+    return true;
+}
+
+/**
+ * @brief Frees an io_uring probe slot without reporting a result.
+ * @param close_socket Queue a close for the slot's direct descriptor.
+ */
+void ScanEngine::retire_uring(uint32_t slot, bool close_socket) {
+    Probe& probe = probes_[slot];
+    if (close_socket) {
+        ring_->queue_close(slot, pack_token(slot, probe.gen & kRingGenMask));
+    }
+    ++probe.gen;
+    free_slots_.push_back(slot);
+    --in_flight_;
+}
+
+/**
+ * @brief Maps a connect completion to a result, with the same statuses and
+ *        retry rules as the epoll path.
+ * @param res 0 when connected, -ECANCELED when the linked timeout fired, else -errno.
+ */
+void ScanEngine::on_connect(uint32_t slot, int32_t res, const ResultCallback& on_result) {
+    Probe& probe = probes_[slot];
+    Pending p{probe.target, probe.port, probe.tag};
+    if (probe.socket_error != 0) {
+        // The chain failed at socket(); the connect was cancelled without running.
+        int err = probe.socket_error;
+        metrics_count_errno(err);
+        retire_uring(slot, false);
+        if ((err == EMFILE || err == ENFILE || err == ENOBUFS) && in_flight_ > 0) {
+            cwnd_.on_loss(monotonic_ms(), 0);
+            queue_.push_front(p);
+            return;
+        }
+        std::cerr << "Error: socket() failed for " << targets_[p.target].host << ":" << p.port
+                  << " - " << std::strerror(err) << "\n";
+        metrics_count_status(PortStatus::CLOSED);
+        on_result(ScanResult{p.target, p.port, PortStatus::CLOSED, 0, p.tag});
+        return;
+    }
+    if (res == 0) {
+        finish(slot, PortStatus::OPEN, on_result);
+        return;
+    }
+    if (res == -ECANCELED) {
+        finish(slot, PortStatus::FILTERED, on_result); // Timeout
+        return;
+    }
+    int err = -res;
+    metrics_count_errno(err);
+    if ((err == EADDRNOTAVAIL || err == ENOBUFS) && in_flight_ > 1) {
+        retire_uring(slot, true);
+        cwnd_.on_loss(monotonic_ms(), 0);
+        queue_.push_front(p);
+        return;
+    }
+    finish(slot, PortStatus::CLOSED, on_result);
+}
+
+/**
+ * @brief Completes a connect that was waited for as writability: OPEN (or the
+ *        hook's session) if the socket has no error, CLOSED otherwise.
+ * @return false if the ring failed.
+ */
+bool ScanEngine::on_writable(uint32_t slot, const ResultCallback& on_result) {
+    int so_error = 0;
+    socklen_t len = sizeof(so_error);
+    if (getsockopt(probes_[slot].fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
+        std::cerr << "Error: getsockopt() failed - " << std::strerror(errno) << "\n";
+        finish(slot, PortStatus::CLOSED, on_result);
+        return true;
+    }
+    if (so_error != 0) {
+        metrics_count_errno(so_error);
+        finish(slot, PortStatus::CLOSED, on_result);
+        return true;
+    }
+    if (hook_) {
+        return begin_session(slot, on_result);
+    }
+    finish(slot, PortStatus::OPEN, on_result);
+    return true;
+}
+
+/**
+ * @brief Handles a ring poll for a hooked probe: its connect, or a step of its session.
+ * @param res Ready events, -ECANCELED when the linked timeout fired, else -errno.
+ * @return false if the ring failed.
+ */
+bool ScanEngine::on_poll(uint32_t slot, int32_t res, const ResultCallback& on_result) {
+    if (probes_[slot].session) {
+        if (res < 0) {
+            end_session(slot, on_result); // Connected, but the exchange ran out of time
+            return true;
+        }
+        return continue_session(slot, hook_->resume(slot), on_result);
+    }
+    if (res == -ECANCELED) {
+        finish(slot, PortStatus::FILTERED, on_result); // Timeout
+        return true;
+    }
+    return on_writable(slot, on_result);
+}
+
+bool ScanEngine::run_uring(const ResultCallback& on_result, const RefillCallback& refill) {
+    bool more = static_cast<bool>(refill);
+
+    while (more || !queue_.empty() || in_flight_ > 0) {
+        // Fill the congestion window; the chains only reach the kernel below.
+        uint64_t now = monotonic_ms();
+        bool throttled = false;
+        while (!free_slots_.empty() && in_flight_ < cwnd_.size()) {
+            if (queue_.empty()) {
+                if (!more || !(more = refill())) break;
+                continue;
+            }
+            if (!limiter_.try_acquire(now)) {
+                throttled = true;
+                break;
+            }
+            Pending p = queue_.front();
+            queue_.pop_front();
+            // Hooked probes keep their socket after connecting, so they are
+            // created and connected directly and only waited for on the ring.
+            LaunchResult launched = hook_ ? launch(p, on_result)
+                                  : launch_uring(p) ? LaunchResult::IN_FLIGHT : LaunchResult::FAILED;
+            if (launched == LaunchResult::FAILED) {
+                return false;
+            }
+            if (launched == LaunchResult::RETRY) {
+                queue_.push_front(p);
+                break;
+            }
+        }
+        if (in_flight_ == 0 && !throttled) {
+            continue;
+        }
+
+        // One system call submits the new chains and pending closes and
+        // waits for completions; deadlines are enforced by the kernel.
+        int wait_ms = throttled ? static_cast<int>(limiter_.wait_ms(now)) : -1;
+        if (!ring_->submit_and_wait(wait_ms)) {
+            return false;
+        }
+        uint64_t token;
+        IoRing::Op op;
+        int32_t res;
+        while (ring_->next_completion(token, op, res)) {
+            uint32_t slot = static_cast<uint32_t>(token & 0xffffffffu);
+            uint32_t gen = static_cast<uint32_t>(token >> 32);
+            Probe& probe = probes_[slot];
+            if ((probe.gen & kRingGenMask) != gen) {
+                continue;
+            }
+            bool ok = true;
+            if (op == IoRing::Op::SOCKET) {
+                probe.socket_error = -res;
+            } else if (op == IoRing::Op::CONNECT) {
+                on_connect(slot, res, on_result);
+            } else if (op == IoRing::Op::POLL) {
+                ok = on_poll(slot, res, on_result);
+            }
+            // Timeout and close completions carry nothing the engine needs.
+            if (!ok) {
+                return false;
+            }
+        }
+    }
+    // Submit the closes queued for the final results.
+    return ring_->submit_and_wait(0);
+}
+
+bool ScanEngine::run_epoll(const ResultCallback& on_result, const RefillCallback& refill) {
+    if (epfd_ < 0) {
+        return false;
+    }
+
+    const int kMaxEvents = 256;
+    struct epoll_event events[kMaxEvents];
+    bool more = static_cast<bool>(refill);
+
+    while (more || !queue_.empty() || in_flight_ > 0) {
+        // Fill the congestion window, pulling new work when the queue runs dry.
+        uint64_t now = monotonic_ms();
+        bool throttled = false;
+        while (!free_slots_.empty() && in_flight_ < cwnd_.size()) {
+            if (queue_.empty()) {
+                if (!more || !(more = refill())) break;
+                continue;
+            }
+            if (!limiter_.try_acquire(now)) {
+                throttled = true;
+                break;
+            }
+            Pending p = queue_.front();
+            queue_.pop_front();
+            if (launch(p, on_result) == LaunchResult::RETRY) {
+                queue_.push_front(p);
+                break;
+            }
+        }
+        if (in_flight_ == 0 && !throttled) {
+            continue;
+        }
+
+        int wait_ms = wheel_.next_timeout_ms(now);
+        if (throttled) {
+            int token_ms = static_cast<int>(limiter_.wait_ms(now));
+            if (wait_ms < 0 || token_ms < wait_ms) wait_ms = token_ms;
+        }
+        int n = epoll_wait(epfd_, events, kMaxEvents, wait_ms);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "Error: epoll_wait() failed - " << std::strerror(errno) << "\n";
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t slot = static_cast<uint32_t>(events[i].data.u64 & 0xffffffffu);
+            uint32_t gen = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            Probe& probe = probes_[slot];
+            if (probe.fd < 0 || probe.gen != gen) {
+                continue;
+            }
+            if (probe.session) {
+                continue_session(slot, hook_->resume(slot), on_result);
+            } else {
+                on_writable(slot, on_result);
+            }
+        }
+
+        wheel_.advance(monotonic_ms(), [&](uint32_t slot, uint32_t gen) {
+            if (probes_[slot].fd >= 0 && probes_[slot].gen == gen) {
+                if (probes_[slot].session) {
+                    end_session(slot, on_result); // Connected, but the exchange ran out of time
+                } else {
+                    finish(slot, PortStatus::FILTERED, on_result); // Timeout
+                }
+            }
+        });
+    }
+    return true;
+}
@@ -0,0 +1,234 @@
+#pragma once
+#include "scanner.h"
+#include "timer_wheel.h"
+#include "rate_control.h"
+#include <sys/socket.h>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class IoRing;
+
+/**
+ * @brief Tunables for the asynchronous connect engine.
+ */
+struct ScanEngineOptions {
+    std::size_t max_in_flight = 1024; ///< Upper bound on concurrent non-blocking connects.
+    uint32_t timeout_ms = 3000;       ///< Per-probe deadline; with adaptive_timeout, the deadline until a target has RTT samples.
+    uint32_t tick_ms = 10;            ///< Timer wheel resolution.
+    bool adaptive_timeout = true;     ///< Derive deadlines from each target's smoothed RTT and variance.
+    uint32_t min_timeout_ms = 100;    ///< Floor for adaptive deadlines.
+    uint32_t max_timeout_ms = 10000;  ///< Ceiling for adaptive deadlines.
+    double rate_limit = 0.0;          ///< Probe launches per second for this engine; 0 = unlimited.
+    std::size_t initial_window = 256; ///< Starting congestion window (capped by max_in_flight).
+    bool io_uring = false;            ///< Probe through io_uring when the kernel supports it; otherwise epoll.
+};
+
+/**
+ * @brief A single completed probe, delivered as soon as its status is known.
+ */
+struct ScanResult {
+    std::size_t target;  ///< Index returned by ScanEngine::add_target().
+    int port;            ///< Probed TCP port.
+    PortStatus status;   ///< OPEN, CLOSED or FILTERED.
+    uint32_t rtt_ms;     ///< Time from connect() to its outcome (a ConnectHook's exchange is not included).
+    uint64_t tag;        ///< Value passed to ScanEngine::submit().
+};
+
+/**
+ * @brief Raises RLIMIT_NOFILE as far as allowed and clamps a concurrency window to it.
+ * @param wanted Requested number of simultaneously open sockets.
+ * @return Concurrency that fits under the descriptor limit, never less than 1.
+ */
+std::size_t clamp_to_fd_limit(std::size_t wanted);
+
+/**
+ * @brief Protocol exchange run on a probe's connection once connect() succeeds.
+ *
+ * Lets a caller keep talking on the socket the engine connected (send a
+ * request, read a greeting, handshake TLS) inside the engine's own loop, so
+ * rate limiting, the congestion window, refill and the io_uring backend
+ * apply to it unchanged. start() and resume() return the poll events
+ * (POLLIN, POLLOUT) to wait for next, or 0 once the exchange is over; the
+ * engine then closes the socket and reports the probe OPEN. The exchange
+ * shares the probe's ScanEngineOptions::timeout_ms, counted from the
+ * connect; if it runs out the probe is reported OPEN as well.
+ */
+class ConnectHook {
+public:
+    virtual ~ConnectHook() {}
+
+    /**
+     * @brief Starts the exchange on a freshly connected socket.
+     * @param slot Engine slot, below ScanEngine::window() and owned by this probe until finish().
+     * @param fd Connected non-blocking socket; the engine closes it after finish().
+     * @param target Index returned by ScanEngine::add_target().
+     * @param port Probed port.
+     * @param tag Value passed to ScanEngine::submit().
+     * @return Events to wait for, or 0 if the exchange is already over.
+     */
+    virtual uint32_t start(uint32_t slot, int fd, std::size_t target, int port, uint64_t tag) = 0;
+
+    /**
+     * @brief Continues the exchange once the requested events are ready.
+     * @return Events to wait for next, or 0 if the exchange is over.
+     */
+    virtual uint32_t resume(uint32_t slot) = 0;
+
+    /**
+     * @brief Ends the exchange, whether it completed or timed out.
+     *
+     * Called exactly once per start(), immediately before the probe's result
+     * is passed to the result callback.
+     */
+    virtual void finish(uint32_t slot) = 0;
+};
+
+/**
+ * @brief Event-loop connect scanner.
+ *
+ * Keeps up to max_in_flight non-blocking connects outstanding on one epoll
+ * instance and expires them through a timer wheel. Results are emitted through
+ * the callback passed to run() in completion order, not submission order.
+ *
+ * Each target carries an RttEstimator fed by connect() round trips, so the
+ * FILTERED deadline tracks the target's real latency. Launches are paced by an
+ * optional token bucket and by an AIMD congestion window that backs off when
+ * round trips inflate well past the smoothed RTT (queueing) or when local
+ * sockets or ephemeral ports run out.
+ *
+ * With ScanEngineOptions::io_uring, probes go through an IoRing instead:
+ * socket, connect and a linked timeout are queued as one chain per probe
+ * and closes are batched with the next submission, so a whole window costs
+ * one io_uring_enter() instead of several system calls per probe. Results
+ * and pacing are identical; if the ring cannot be set up the engine says so
+ * once on stderr and uses epoll. The ring is single-issuer, so run() must be
+ * called on the thread that constructed the engine.
+ *
+ * A ConnectHook turns the engine into a service prober: connected sockets
+ * stay open for the hook's exchange instead of being closed right away.
+ * Under io_uring those probes use ordinary descriptors, since the hook
+ * reads and writes the socket itself.
+ */
+class ScanEngine {
+public:
+    using ResultCallback = std::function<void(const ScanResult&)>;
+    /// Called when the queue runs dry; submits more probes and returns false once no work is left.
+    using RefillCallback = std::function<bool()>;
+
+    explicit ScanEngine(const ScanEngineOptions& options = ScanEngineOptions());
+    ~ScanEngine();
+
+    ScanEngine(const ScanEngine&) = delete;
+    ScanEngine& operator=(const ScanEngine&) = delete;
+
+    /**
+     * @brief Registers a resolved target address.
+     * @param host Hostname, kept for reporting.
+     * @param addr Resolved socket address; the port field is overwritten per probe.
+     * @param addr_len Length of addr.
+     * @param rtt Estimate carried over from earlier runs (see TargetCache::rtt()).
+     * @return Target index to pass to submit().
+     */
+    std::size_t add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                           const RttEstimator& rtt = RttEstimator());
+
+    /** @brief Hostname registered for a target index. */
+    const std::string& target_host(std::size_t target) const { return targets_[target].host; }
+
+    /** @brief RTT estimate for a target, including samples from this run. */
+    const RttEstimator& target_rtt(std::size_t target) const { return targets_[target].rtt; }
+
+    /**
+     * @brief Queues a probe; nothing is sent until run() is called.
+     * @param target Index returned by add_target().
+     * @param port TCP port to probe.
+     * @param tag Caller's value, handed back in ScanResult::tag.
+     */
+    void submit(std::size_t target, int port, uint64_t tag = 0);
+
+    /**
+     * @brief Drives the event loop until every submitted probe has a result.
+     * @param on_result Invoked once per probe as it completes.
+     * @param refill Optional source of further probes, polled whenever the
+     *        queue is empty so the window stays full across batches.
+     * @return false if the event loop could not be created.
+     */
+    bool run(const ResultCallback& on_result, const RefillCallback& refill = RefillCallback());
+
+    /**
+     * @brief Installs a protocol exchange for connected probes; call before run().
+     * @param hook Not owned; must outlive run(). nullptr reports OPEN on connect.
+     */
+    void set_connect_hook(ConnectHook* hook) { hook_ = hook; }
+
+    /** @brief Number of probe slots, i.e. the upper bound on ConnectHook slot numbers. */
+    std::size_t window() const { return window_; }
+
+    /** @brief True if probes go through io_uring rather than epoll. */
+    bool using_io_uring() const { return ring_ != nullptr; }
+
+private:
+    struct Target {
+        std::string host;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        RttEstimator rtt;
+    };
+
+    struct Probe {
+        int fd = -1;
+        uint32_t gen = 0;
+        std::size_t target = 0;
+        int port = 0;
+        uint64_t tag = 0;
+        uint64_t start_ms = 0;
+        uint64_t start_us = 0;  ///< connect() time, for metrics.
+        int socket_error = 0;   ///< io_uring: errno from the socket step of the chain.
+        bool session = false;   ///< Connected and handed to the ConnectHook.
+        uint32_t rtt_ms = 0;    ///< Connect round trip, reported once the session ends.
+    };
+
+    struct Pending {
+        std::size_t target;
+        int port;
+        uint64_t tag;
+    };
+
+    enum class LaunchResult { IN_FLIGHT, DONE, RETRY, FAILED };
+
+    LaunchResult launch(const Pending& p, const ResultCallback& on_result);
+    void account(uint32_t slot, PortStatus status, uint64_t now);
+    void finish(uint32_t slot, PortStatus status, const ResultCallback& on_result);
+    void release(uint32_t slot);
+    bool begin_session(uint32_t slot, const ResultCallback& on_result);
+    bool continue_session(uint32_t slot, uint32_t events, const ResultCallback& on_result);
+    void end_session(uint32_t slot, const ResultCallback& on_result);
+    uint32_t session_remaining_ms(const Probe& probe, uint64_t now) const;
+    bool run_epoll(const ResultCallback& on_result, const RefillCallback& refill);
+    bool run_uring(const ResultCallback& on_result, const RefillCallback& refill);
+    bool on_writable(uint32_t slot, const ResultCallback& on_result);
+    bool launch_uring(const Pending& p);
+    void on_connect(uint32_t slot, int32_t res, const ResultCallback& on_result);
+    bool on_poll(uint32_t slot, int32_t res, const ResultCallback& on_result);
+    void retire_uring(uint32_t slot, bool close_socket);
+
+    ScanEngineOptions options_;
+    int epfd_;
+    std::vector<Target> targets_;
+    std::deque<Pending> queue_;
+    std::vector<Probe> probes_;
+    std::vector<uint32_t> free_slots_;
+    std::size_t window_;
+    std::size_t in_flight_;
+    TimerWheel wheel_;
+    TokenBucket limiter_;
+    CongestionWindow cwnd_;
+    ConnectHook* hook_;
+    std::unique_ptr<IoRing> ring_;
+    std::vector<sockaddr_storage> ring_addrs_; ///< Per-slot connect address while an io_uring probe is in flight.
+};
@@ -0,0 +1,183 @@
+#include "scan_journal.h"
+#include "scan_record.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kJournalMagic[4] = {'P', 'S', 'J', 'N'};
+const uint16_t kJournalVersion = 1;
+
+/**
+ * @brief Journal file header; followed by num_chunks done bytes (padded to 8)
+ *        and (total + 3) / 4 bytes of packed statuses.
+ */
+struct JournalHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t endian;
+    uint64_t fingerprint;
+    uint64_t total;
+    uint64_t chunk_size;
+    uint64_t num_chunks;
+};
+
+static_assert(sizeof(JournalHeader) == 40, "JournalHeader layout changed");
+
+std::size_t done_bytes(std::size_t num_chunks) {
+    return (num_chunks + 7) & ~std::size_t(7);
+}
+
+/// FNV-1a, 64-bit.
+uint64_t fnv1a(uint64_t h, const void* data, std::size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (std::size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+} // namespace
+
+uint64_t scan_fingerprint(const std::vector<HostEntry>& hosts, const std::vector<int>& ports) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const auto& host : hosts) {
+        h = fnv1a(h, host.name.data(), host.name.size() + 1);
+        h = fnv1a(h, &host.addr.family, sizeof(host.addr.family));
+        h = fnv1a(h, host.addr.bytes, sizeof(host.addr.bytes));
+    }
+    for (int port : ports) {
+        h = fnv1a(h, &port, sizeof(port));
+    }
+    return h;
+}
+
+ScanJournal::ScanJournal()
+    : base_(nullptr), size_(0), done_(nullptr), status_(nullptr),
+      chunk_size_(0), num_chunks_(0), resumed_(false) {}
+
+ScanJournal::~ScanJournal() {
+    close();
+}
+
+bool ScanJournal::open(const std::string& path, uint64_t fingerprint, std::size_t total, std::size_t chunk_size) {
+    close();
+    path_ = path;
+    resumed_ = false;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open journal '" << path << "' - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        std::cerr << "Error: fstat() of journal '" << path << "' failed - " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+
+    // Reuse the file only if it was written for this exact scan.
+    JournalHeader header;
+    bool reuse = false;
+    if (static_cast<std::size_t>(st.st_size) >= sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))) {
+        reuse = std::memcmp(header.magic, kJournalMagic, sizeof(header.magic)) == 0 &&
+                header.version == kJournalVersion && header.endian == kBinaryEndianMark &&
+                header.fingerprint == fingerprint && header.total == total &&
+                header.chunk_size > 0 && header.chunk_size % 4 == 0 &&
+                header.num_chunks == (total + header.chunk_size - 1) / header.chunk_size;
+        if (!reuse) {
+            std::cerr << "Note: journal '" << path << "' belongs to a different scan; starting over.\n";
+        }
+    }
+    if (!reuse) {
+        chunk_size = chunk_size ? (chunk_size + 3) & ~std::size_t(3) : 4;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+        header.version = kJournalVersion;
+        header.endian = kBinaryEndianMark;
+        header.fingerprint = fingerprint;
+        header.total = total;
+        header.chunk_size = chunk_size;
+        header.num_chunks = (total + chunk_size - 1) / chunk_size;
+    }
+    chunk_size_ = static_cast<std::size_t>(header.chunk_size);
+    num_chunks_ = static_cast<std::size_t>(header.num_chunks);
+    size_ = sizeof(JournalHeader) + done_bytes(num_chunks_) + (total + 3) / 4;
+
+    // A fresh journal is truncated to zero first so that no stale done bytes survive.
+    if ((!reuse && ftruncate(fd, 0) < 0) || ftruncate(fd, static_cast<off_t>(size_)) < 0 ||
+        (!reuse && pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))) {
+        std::cerr << "Error: cannot size journal '" << path << "' - " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: mmap() of journal '" << path << "' failed - " << std::strerror(errno) << "\n";
+        size_ = 0;
+        return false;
+    }
+    base_ = static_cast<uint8_t*>(base);
+    done_ = base_ + sizeof(JournalHeader);
+    status_ = done_ + done_bytes(num_chunks_);
+    resumed_ = reuse && chunks_done() > 0;
+    return true;
+}
+
+void ScanJournal::close() {
+    if (base_) {
+        msync(base_, size_, MS_ASYNC);
+        munmap(base_, size_);
+    }
+    base_ = done_ = status_ = nullptr;
+    size_ = 0;
+}
+
+void ScanJournal::remove() {
+    close();
+    if (!path_.empty() && unlink(path_.c_str()) < 0 && errno != ENOENT) {
+        std::cerr << "Error: cannot remove journal '" << path_ << "' - " << std::strerror(errno) << "\n";
+    }
+}
+
+std::size_t ScanJournal::chunks_done() const {
+    std::size_t n = 0;
+    for (std::size_t c = 0; c < num_chunks_; ++c) {
+        n += done_[c] ? 1 : 0;
+    }
+    return n;
+}
+
+bool ScanJournal::chunk_done(std::size_t chunk) const {
+    return done_ && done_[chunk] != 0;
+}
+
+void ScanJournal::commit_chunk(std::size_t chunk, const std::vector<uint8_t>& status) {
+    if (!base_) {
+        return;
+    }
+    // chunk_size_ is a multiple of 4, so every chunk starts on a byte boundary
+    // and concurrent commits never share a byte.
+    uint8_t* out = status_ + chunk * chunk_size_ / 4;
+    std::memset(out, 0, (status.size() + 3) / 4);
+    for (std::size_t k = 0; k < status.size(); ++k) {
+        out[k / 4] |= static_cast<uint8_t>((status[k] & 3u) << ((k % 4) * 2));
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    done_[chunk] = 1;
+}
+
+PortStatus ScanJournal::status(std::size_t i) const {
+    return static_cast<PortStatus>((status_[i / 4] >> ((i % 4) * 2)) & 3u);
+}
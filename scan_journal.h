@@ -0,0 +1,89 @@
+#pragma once
+#include "scanner.h"
+#include "target_spec.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Identifies a scan by its resolved hosts and port list.
+ *
+ * Two runs with the same fingerprint probe the same (host, port) matrix in the
+ * same order, so a journal written by one can be resumed by the other.
+ */
+uint64_t scan_fingerprint(const std::vector<HostEntry>& hosts, const std::vector<int>& ports);
+
+/**
+ * @brief Memory-mapped checkpoint of a chunked hosts x ports scan.
+ *
+ * The file holds a header, one "done" byte per chunk and two bits of
+ * PortStatus per probe. Each worker copies a chunk's results in and then
+ * marks it done, so the file always describes a prefix-free set of finished
+ * chunks; the kernel writes dirty pages back even if the process is killed.
+ * A restarted scan with the same fingerprint skips finished chunks and
+ * reads their results back from the journal instead.
+ *
+ * commit_chunk() may be called concurrently for different chunks.
+ */
+class ScanJournal {
+public:
+    ScanJournal();
+    ~ScanJournal();
+
+    ScanJournal(const ScanJournal&) = delete;
+    ScanJournal& operator=(const ScanJournal&) = delete;
+
+    /**
+     * @brief Opens an existing journal for the same scan, or starts a new one.
+     * @param path Journal file.
+     * @param fingerprint scan_fingerprint() of the scan.
+     * @param total Number of probes in the scan.
+     * @param chunk_size Probes per chunk for a new journal (rounded up to a
+     *        multiple of 4); a resumed journal keeps its own.
+     * @return false on I/O error (an error is printed). A journal for a
+     *         different scan is replaced, with a note on stderr.
+     */
+    bool open(const std::string& path, uint64_t fingerprint, std::size_t total, std::size_t chunk_size);
+
+    /** @brief Unmaps the journal, keeping the file. */
+    void close();
+
+    /** @brief Unmaps and deletes the journal; call once the scan has completed. */
+    void remove();
+
+    /** @brief True if open() found progress from an earlier run. */
+    bool resumed() const { return resumed_; }
+
+    /** @brief Probes per chunk. */
+    std::size_t chunk_size() const { return chunk_size_; }
+
+    /** @brief Number of chunks in the scan. */
+    std::size_t num_chunks() const { return num_chunks_; }
+
+    /** @brief Number of chunks already finished. */
+    std::size_t chunks_done() const;
+
+    /** @brief True if a chunk's results are in the journal. */
+    bool chunk_done(std::size_t chunk) const;
+
+    /**
+     * @brief Stores a finished chunk's results and marks it done.
+     * @param chunk Chunk index.
+     * @param status PortStatus per probe in the chunk.
+     */
+    void commit_chunk(std::size_t chunk, const std::vector<uint8_t>& status);
+
+    /** @brief Result of probe i (only meaningful if its chunk is done). */
+    PortStatus status(std::size_t i) const;
+
+private:
+    std::string path_;
+    uint8_t* base_;
+    std::size_t size_;
+    uint8_t* done_;
+    uint8_t* status_;
+    std::size_t chunk_size_;
+    std::size_t num_chunks_;
+    bool resumed_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file scan_record.h
+ * @brief On-disk layout of the fixed-record binary result format.
+ *
+ * A file is one BinaryHeader followed by BinaryRecord entries back to back.
+ * All integers are in host byte order (the writer's endianness is recorded in
+ * the header). Readers can mmap the file and index records directly:
+ *
+ *   const BinaryHeader* h = static_cast<const BinaryHeader*>(base);
+ *   const BinaryRecord* r = reinterpret_cast<const BinaryRecord*>(h + 1);
+ *   std::size_t n = (file_size - sizeof(BinaryHeader)) / h->record_size;
+ *
+ * Header-only so that analysis tools can include it without linking the scanner.
+ */
+
+/// "PSCN" in file order.
+static const char kBinaryMagic[4] = {'P', 'S', 'C', 'N'};
+static const uint16_t kBinaryVersion = 1;
+static const uint16_t kBinaryEndianMark = 0x0102;
+
+/**
+ * @brief File header; 16 bytes.
+ */
+struct BinaryHeader {
+    char magic[4];          ///< kBinaryMagic.
+    uint16_t version;       ///< kBinaryVersion.
+    uint16_t endian;        ///< kBinaryEndianMark as written by the producer.
+    uint16_t record_size;   ///< sizeof(BinaryRecord); lets readers skip fields added later.
+    uint16_t reserved0;
+    uint32_t reserved1;
+};
+
+/// BinaryRecord::flags bits.
+enum BinaryRecordFlags : uint8_t {
+    kRecordHasCert    = 1u << 0,  ///< A TLS handshake was attempted for this port.
+    kRecordCertValid  = 1u << 1,  ///< A certificate was retrieved.
+    kRecordSelfSigned = 1u << 2,  ///< The certificate is self-signed.
+    kRecordChanged    = 1u << 3,  ///< Diff mode: differs from the previous run, whose PortState is in reserved[0].
+    kRecordServiceConfirmed = 1u << 4,  ///< The service answered in its configured protocol.
+};
+
+/**
+ * @brief One (address, port) result; 24 bytes, naturally aligned.
+ */
+struct BinaryRecord {
+    uint8_t addr[16];   ///< IPv4 in the first 4 bytes, or a full IPv6 address.
+    uint16_t port;      ///< TCP port.
+    uint8_t family;     ///< 4 or 6; 0 if the host could not be resolved.
+    uint8_t status;     ///< PortStatus value (0 OPEN, 1 CLOSED, 2 FILTERED).
+    uint8_t flags;      ///< BinaryRecordFlags.
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(BinaryHeader) == 16, "BinaryHeader layout changed");
+static_assert(sizeof(BinaryRecord) == 24, "BinaryRecord layout changed");
@@ -1,12 +1,23 @@
 #include "scanner.h"
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <netdb.h>
-#include <cstring>
-#include <cerrno>
-#include <iostream>
+#include "scan_engine.h"
+#include "resolver.h"
+#include "result_store.h"
+
+/**
+ * @brief Resolves a hostname through the shared target cache.
+ * @param host Hostname or IP address.
+ * @param addr Output address.
+ * @param addr_len Output address length.
+ * @return true on success.
+ */
+bool resolve_host(const std::string& host, sockaddr_storage& addr, socklen_t& addr_len) {
+    TargetAddress target;
+    if (!default_target_cache().lookup(host, target)) {
+        return false;
+    }
+    addr_len = target.to_sockaddr(0, addr);
+    return true;
+}
 
 /**
  * @brief Attempts to connect to a TCP port on a host.
@@ -16,73 +27,35 @@
  * @return PortStatus (OPEN, CLOSED, FILTERED)
  */
 PortStatus scan_port(const std::string& host, int port, int timeout_sec) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        std::cerr << "Error: socket() failed for " << host << ":" << port
-                  << " - " << std::strerror(errno) << "\n";
+    sockaddr_storage addr;
+    socklen_t addr_len = 0;
+    if (!resolve_host(host, addr, addr_len)) {
         return PortStatus::CLOSED;
     }
 
-    struct hostent* server = gethostbyname(host.c_str());
-    if (!server) {
-        std::cerr << "Error: could not resolve host '" << host << "' - "
-                  << hstrerror(h_errno) << "\n";
-        close(sock);
-        return PortStatus::CLOSED;
-    }
+    ScanEngineOptions options;
+    options.max_in_flight = 1;
+    options.timeout_ms = static_cast<uint32_t>(timeout_sec) * 1000u;
+    options.max_timeout_ms = options.timeout_ms;
+    ScanEngine engine(options);
 
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    std::memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    addr.sin_port = htons(port);
-
-    // Set non-blocking
-    int flags = fcntl(sock, F_GETFL, 0);
-    if (flags < 0) {
-        std::cerr << "Error: fcntl(F_GETFL) failed - " << std::strerror(errno) << "\n";
-        close(sock);
+    // The engine only lives for this call; the target's RTT estimate is kept
+    // in the resolver cache so later calls get an adaptive deadline.
+    TargetCache& cache = default_target_cache();
+    std::size_t target = engine.add_target(host, addr, addr_len, cache.rtt(host));
+    PortStatus status = PortStatus::CLOSED;
+    engine.submit(target, port);
+    if (!engine.run([&status](const ScanResult& r) { status = r.status; })) {
         return PortStatus::CLOSED;
     }
-    if (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
-        std::cerr << "Error: fcntl(F_SETFL) failed - " << std::strerror(errno) << "\n";
-        close(sock);
-        return PortStatus::CLOSED;
-    }
-
-    int res = connect(sock, (struct sockaddr*)&addr, sizeof(addr));
-    if (res < 0 && errno != EINPROGRESS) {
-        close(sock);
-        return PortStatus::CLOSED;
-    }
-
-    fd_set fdset;
-    FD_ZERO(&fdset);
-    FD_SET(sock, &fdset);
-    struct timeval tv;
-    tv.tv_sec = timeout_sec;
-    tv.tv_usec = 0;
+    cache.record_rtt(host, engine.target_rtt(target));
+    return status;
+}
 
-    res = select(sock + 1, nullptr, &fdset, nullptr, &tv);
-    if (res == 1) {
-        int so_error = 0;
-        socklen_t len = sizeof(so_error);
-        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
-            std::cerr << "Error: getsockopt() failed - " << std::strerror(errno) << "\n";
-            close(sock);
-            return PortStatus::CLOSED;
-        }
-        close(sock);
-        return (so_error == 0) ? PortStatus::OPEN : PortStatus::CLOSED;
-    } else if (res == 0) {
-        close(sock);
-        return PortStatus::FILTERED; // Timeout
-    } else {
-        std::cerr << "Error: select() failed for " << host << ":" << port
-                  << " - " << std::strerror(errno) << "\n";
-        close(sock);
-        return PortStatus::CLOSED;
-    }
+PortStatus scan_port(const std::string& host, int port, ResultStore& store, int timeout_sec) {
+    PortStatus status = scan_port(host, port, timeout_sec);
+    store.record(store.add_host(host), port, status);
+    return status;
 }
 
 /**
@@ -97,4 +70,4 @@ std::string status_to_string(PortStatus status) {
         case PortStatus::FILTERED: return "FILTERED";
         default: return "UNKNOWN";
     }
-}
\ No newline at end of file
+}
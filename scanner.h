@@ -1,4 +1,6 @@
+#pragma once
 #include <string>
+#include <sys/socket.h>
 /**
  * @brief Enum representing the status of a port.
  * 
@@ -8,8 +10,24 @@
  */
 enum class PortStatus { OPEN, CLOSED, FILTERED };
 
+class ResultStore;
+
+/**
+ * @brief Resolves a hostname to an IPv4 or IPv6 socket address.
+ *
+ * Lookups go through default_target_cache(), so each host is resolved once
+ * per TTL no matter how many ports are probed.
+ * @param host The hostname or IP address to resolve.
+ * @param addr Output address (port left as 0).
+ * @param addr_len Output address length.
+ * @return true on success; on failure an error is printed to stderr.
+ */
+bool resolve_host(const std::string& host, sockaddr_storage& addr, socklen_t& addr_len);
+
 /**
  * @brief Attempts to connect to a TCP port on a host.
+ *
+ * Synchronous wrapper that runs a single probe through ScanEngine.
  * @param host The hostname or IP address to scan.
  * @param port The port number to scan.
  * @param timeout_sec Timeout in seconds for the connection attempt (default: 3).
@@ -17,6 +35,16 @@ enum class PortStatus { OPEN, CLOSED, FILTERED };
  */
 PortStatus scan_port(const std::string& host, int port, int timeout_sec = 3);
 
+/**
+ * @brief Scans a TCP port and records the result in a result store.
+ * @param host The hostname or IP address to scan.
+ * @param port The port number to scan.
+ * @param store Store that receives the result (the host is added if new).
+ * @param timeout_sec Timeout in seconds for the connection attempt (default: 3).
+ * @return PortStatus indicating if the port is OPEN, CLOSED, or FILTERED.
+ */
+PortStatus scan_port(const std::string& host, int port, ResultStore& store, int timeout_sec = 3);
+
 /**
  * @brief Converts PortStatus enum to a human-readable string.
  * @param status The PortStatus value to convert.
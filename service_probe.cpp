@@ -0,0 +1,356 @@
+#include "service_probe.h"
+#include "cert_harvester.h"
+#include "scan_engine.h"
+#include "metrics.h"
+#include <openssl/err.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+/// X.224 Connection Request in a TPKT, carrying an RDP_NEG_REQ for TLS or CredSSP.
+const unsigned char kRdpConnectionRequest[] = {
+    0x03, 0x00, 0x00, 0x13,                         // TPKT v3, length 19
+    0x0e, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00,       // X.224 CR, no cookie
+    0x01, 0x00, 0x08, 0x00, 0x03, 0x00, 0x00, 0x00, // RDP_NEG_REQ: PROTOCOL_SSL | PROTOCOL_HYBRID
+};
+
+enum class Parse { NEED_MORE, MATCH, MISMATCH };
+
+/**
+ * @brief Looks for the "SSH-" identification line; servers may send other lines first.
+ */
+Parse parse_ssh(char* buf, std::size_t len, std::size_t& off, std::size_t& out_len) {
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        if (buf[i] != '\n') {
+            continue;
+        }
+        if (i - line >= 4 && std::memcmp(buf + line, "SSH-", 4) == 0) {
+            off = line;
+            out_len = i - line;
+            if (out_len > 0 && buf[line + out_len - 1] == '\r') --out_len;
+            return Parse::MATCH;
+        }
+        line = i + 1;
+    }
+    return len < kServiceBufferSize ? Parse::NEED_MORE : Parse::MISMATCH;
+}
+
+/**
+ * @brief Checks for the 12-byte "RFB xxx.yyy\n" ProtocolVersion greeting.
+ */
+Parse parse_rfb(const char* buf, std::size_t len, std::size_t& out_len) {
+    if (len < 12) {
+        return std::memcmp(buf, "RFB ", len < 4 ? len : 4) == 0 ? Parse::NEED_MORE : Parse::MISMATCH;
+    }
+    if (std::memcmp(buf, "RFB ", 4) != 0 || buf[7] != '.' || buf[11] != '\n') {
+        return Parse::MISMATCH;
+    }
+    out_len = 11;
+    return Parse::MATCH;
+}
+
+/**
+ * @brief Checks for a TPKT-framed X.224 Connection Confirm and describes the
+ *        negotiated security protocol in place.
+ */
+Parse parse_rdp(char* buf, std::size_t len, std::size_t& out_len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(buf);
+    if (len < 4) {
+        return len == 0 || p[0] == 0x03 ? Parse::NEED_MORE : Parse::MISMATCH;
+    }
+    std::size_t tpkt_len = static_cast<std::size_t>(p[2]) << 8 | p[3];
+    if (p[0] != 0x03 || p[1] != 0x00 || tpkt_len < 11) {
+        return Parse::MISMATCH;
+    }
+    if (len < tpkt_len && len < kServiceBufferSize) {
+        return Parse::NEED_MORE;
+    }
+    if ((p[5] & 0xf0) != 0xd0) {
+        return Parse::MISMATCH;
+    }
+    const char* security = "standard RDP security";
+    char other[32];
+    if (tpkt_len >= 19 && len >= 19) {
+        uint32_t value = static_cast<uint32_t>(p[15]) | static_cast<uint32_t>(p[16]) << 8 |
+                         static_cast<uint32_t>(p[17]) << 16 | static_cast<uint32_t>(p[18]) << 24;
+        if (p[11] == 0x02) {
+            switch (value) {
+                case 0: break;
+                case 1: security = "TLS"; break;
+                case 2: security = "CredSSP"; break;
+                case 8: security = "CredSSP EX"; break;
+                default:
+                    std::snprintf(other, sizeof(other), "protocol 0x%x", value);
+                    security = other;
+            }
+        } else if (p[11] == 0x03) {
+            std::snprintf(other, sizeof(other), "negotiation failure %u", value);
+            security = other;
+        }
+    }
+    int n = std::snprintf(buf, kServiceBufferSize, "RDP (%s)", security);
+    out_len = n > 0 ? static_cast<std::size_t>(n) : 0;
+    return Parse::MATCH;
+}
+
+/**
+ * @brief Engine settings for a prober: its deadline also caps the adaptive one.
+ */
+ScanEngineOptions engine_options(const ServiceProberOptions& options) {
+    ScanEngineOptions engine;
+    engine.max_in_flight = options.max_in_flight;
+    engine.timeout_ms = options.timeout_ms;
+    engine.tick_ms = options.tick_ms;
+    engine.adaptive_timeout = options.adaptive_timeout;
+    engine.min_timeout_ms = options.min_timeout_ms;
+    engine.max_timeout_ms = options.timeout_ms;
+    engine.rate_limit = options.rate_limit;
+    engine.io_uring = options.io_uring;
+    return engine;
+}
+
+} // namespace
+
+ServiceProtocol service_protocol_for(const std::string& label) {
+    if (label == "SSH") return ServiceProtocol::SSH;
+    if (label == "VNC" || label == "RFB") return ServiceProtocol::RFB;
+    if (label == "RDP") return ServiceProtocol::RDP;
+    if (label == "HTTPS" || label == "TLS") return ServiceProtocol::TLS;
+    return ServiceProtocol::NONE;
+}
+
+ServiceProber::ServiceProber(const ServiceProberOptions& options)
+    : engine_(engine_options(options)),
+      finished_(nullptr),
+      tls_queued_(false) {
+    conns_.resize(engine_.window());
+    engine_.set_connect_hook(this);
+}
+
+ServiceProber::~ServiceProber() {
+    for (auto& c : conns_) {
+        if (c.ssl) SSL_free(c.ssl);
+    }
+}
+
+std::size_t ServiceProber::add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                                      const RttEstimator& rtt) {
+    return engine_.add_target(host, addr, addr_len, rtt);
+}
+
+void ServiceProber::submit(std::size_t target, int port, ServiceProtocol protocol) {
+    if (protocol == ServiceProtocol::TLS) tls_queued_ = true;
+    engine_.submit(target, port, static_cast<uint64_t>(protocol));
+}
+
+/**
+ * @brief Moves a freshly connected socket on to its protocol probe.
+ */
+uint32_t ServiceProber::start(uint32_t slot, int fd, std::size_t target, int port, uint64_t tag) {
+    Conn& c = conns_[slot];
+    c.fd = fd;
+    c.protocol = static_cast<ServiceProtocol>(tag);
+    c.target = target;
+    c.port = port;
+    c.phase_start_us = monotonic_us();
+    c.sent = 0;
+    c.len = 0;
+    c.identified = false;
+    c.banner = c.buf;
+    c.cert = CertInfo();
+    c.stage = Stage::DONE;
+
+    switch (c.protocol) {
+        case ServiceProtocol::NONE:
+            return 0;
+        case ServiceProtocol::SSH:
+        case ServiceProtocol::RFB:
+            // The server speaks first.
+            c.stage = Stage::READING;
+            return POLLIN;
+        case ServiceProtocol::RDP:
+            c.stage = Stage::SENDING;
+            return drive_send(c);
+        case ServiceProtocol::TLS: {
+            const std::string& host = engine_.target_host(target);
+            c.ssl = TlsContext::instance().new_ssl();
+            if (!c.ssl) {
+                return 0;
+            }
+            SSL_set_fd(c.ssl, fd);
+            SSL_set_tlsext_host_name(c.ssl, host.c_str());
+            SSL_set_connect_state(c.ssl);
+            c.stage = Stage::HANDSHAKING;
+            return drive_handshake(c);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Dispatches readiness to the connection's current stage.
+ */
+uint32_t ServiceProber::resume(uint32_t slot) {
+    Conn& c = conns_[slot];
+    switch (c.stage) {
+        case Stage::SENDING: return drive_send(c);
+        case Stage::READING: return drive_read(c);
+        case Stage::HANDSHAKING: return drive_handshake(c);
+        case Stage::DONE: break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases the slot's SSL object and marks its state for the result
+ *        the engine emits next.
+ */
+void ServiceProber::finish(uint32_t slot) {
+    Conn& c = conns_[slot];
+    if (c.ssl) {
+        SSL_free(c.ssl);
+        c.ssl = nullptr;
+    }
+    c.fd = -1;
+    c.stage = Stage::DONE;
+    finished_ = &c;
+}
+
+/**
+ * @brief Writes the rest of the request, then waits for the reply.
+ */
+uint32_t ServiceProber::drive_send(Conn& c) {
+    const std::size_t total = sizeof(kRdpConnectionRequest);
+    while (c.sent < total) {
+        ssize_t n = send(c.fd, kRdpConnectionRequest + c.sent, total - c.sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return POLLOUT;
+            metrics_count_errno(errno);
+            return 0;
+        }
+        c.sent += static_cast<std::size_t>(n);
+    }
+    c.stage = Stage::READING;
+    return POLLIN;
+}
+
+/**
+ * @brief Reads reply bytes into the connection buffer until the protocol's
+ *        greeting is complete, rejected, or the peer closes.
+ */
+uint32_t ServiceProber::drive_read(Conn& c) {
+    for (;;) {
+        bool eof = false;
+        if (c.len < kServiceBufferSize) {
+            ssize_t n = recv(c.fd, c.buf + c.len, kServiceBufferSize - c.len, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return POLLIN;
+                metrics_count_errno(errno);
+                eof = true;
+            } else if (n == 0) {
+                eof = true;
+            } else {
+                c.len += static_cast<std::size_t>(n);
+            }
+        }
+
+        std::size_t off = 0, len = 0;
+        Parse parse = Parse::MISMATCH;
+        switch (c.protocol) {
+            case ServiceProtocol::SSH: parse = parse_ssh(c.buf, c.len, off, len); break;
+            case ServiceProtocol::RFB: parse = parse_rfb(c.buf, c.len, len); break;
+            case ServiceProtocol::RDP: parse = parse_rdp(c.buf, c.len, len); break;
+            default: break;
+        }
+        if (parse == Parse::MATCH) {
+            // Move the banner to the front of the buffer and keep it printable.
+            std::memmove(c.buf, c.buf + off, len);
+            for (std::size_t i = 0; i < len; ++i) {
+                unsigned char ch = static_cast<unsigned char>(c.buf[i]);
+                if (ch < 0x20 || ch > 0x7e) c.buf[i] = '.';
+            }
+            c.len = len;
+            c.identified = true;
+            return 0;
+        }
+        if (parse == Parse::MISMATCH || eof) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Advances the TLS handshake and asks for whatever it needs next.
+ */
+uint32_t ServiceProber::drive_handshake(Conn& c) {
+    ERR_clear_error();
+    int rc = SSL_do_handshake(c.ssl);
+    if (rc == 1) {
+        metrics_record(MetricPhase::TLS_HANDSHAKE, monotonic_us() - c.phase_start_us);
+        identify_tls(c);
+        return 0;
+    }
+
+    int err = SSL_get_error(c.ssl, rc);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        return err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT;
+    }
+    log_ssl_errors("SSL_do_handshake");
+    return 0;
+}
+
+/**
+ * @brief Takes the peer certificate and TLS version from a completed handshake.
+ */
+void ServiceProber::identify_tls(Conn& c) {
+    c.identified = true;
+    X509* cert = SSL_get_peer_certificate(c.ssl);
+    if (cert) {
+        c.cert = cert_info_from_x509(cert);
+        X509_free(cert);
+    } else {
+        std::cerr << "Error: no certificate presented by " << engine_.target_host(c.target)
+                  << ":" << c.port << "\n";
+        log_ssl_errors("SSL_get_peer_certificate");
+    }
+    c.banner = SSL_get_version(c.ssl);
+    c.len = std::strlen(c.banner);
+
+    // Send close_notify so the server sees an orderly close.
+    SSL_shutdown(c.ssl);
+    ERR_clear_error();
+}
+
+bool ServiceProber::run(const ResultCallback& on_result, const RefillCallback& refill) {
+    if (tls_queued_ && !TlsContext::instance().ctx()) {
+        return false;
+    }
+    tls_queued_ = false;
+    return engine_.run(
+        [&](const ScanResult& r) {
+            ServiceResult result{r.target, r.port, static_cast<ServiceProtocol>(r.tag), r.status, false, nullptr, 0,
+                                 CertInfo()};
+            // Probes that reached the hook have their protocol state in the
+            // slot finish() just released; the rest only have a connect result.
+            if (finished_) {
+                if (finished_->identified) {
+                    result.identified = true;
+                    result.banner = finished_->banner;
+                    result.banner_len = finished_->len;
+                }
+                result.cert = std::move(finished_->cert);
+                finished_ = nullptr;
+            }
+            on_result(result);
+        },
+        refill);
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "scanner.h"
+#include "cert_utils.h"
+#include "scan_engine.h"
+#include "rate_control.h"
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Application protocol a ServiceProber checks for after connecting.
+ */
+enum class ServiceProtocol {
+    NONE,  ///< Connect only.
+    SSH,   ///< Read the server's "SSH-" identification line (RFC 4253).
+    RFB,   ///< Read the VNC "RFB xxx.yyy" version greeting (RFC 6143).
+    RDP,   ///< Send an X.224 Connection Request and parse the Connection Confirm.
+    TLS,   ///< TLS handshake on the connected socket and peer certificate.
+};
+
+/**
+ * @brief Maps a configured protocol label ("SSH", "VNC", "RDP", "HTTPS") to its probe.
+ * @return ServiceProtocol::NONE for labels without a probe.
+ */
+ServiceProtocol service_protocol_for(const std::string& label);
+
+/// Bytes of reply each connection can hold; greetings longer than this are cut off.
+const std::size_t kServiceBufferSize = 256;
+
+/**
+ * @brief Tunables for the service prober.
+ */
+struct ServiceProberOptions {
+    std::size_t max_in_flight = 256; ///< Concurrent connections.
+    uint32_t timeout_ms = 3000;      ///< Deadline covering connect and the protocol probe together.
+    uint32_t tick_ms = 10;           ///< Timer wheel resolution.
+    bool adaptive_timeout = true;    ///< Cut the connect phase short using the target's measured RTT.
+    uint32_t min_timeout_ms = 100;   ///< Floor for the adaptive connect deadline.
+    double rate_limit = 0.0;         ///< Connection attempts per second; 0 = unlimited.
+    bool io_uring = false;           ///< Connect and wait through io_uring when the kernel supports it.
+};
+
+/**
+ * @brief Outcome of one probe, delivered as soon as it completes.
+ */
+struct ServiceResult {
+    std::size_t target;        ///< Index returned by ServiceProber::add_target().
+    int port;                  ///< Port probed.
+    ServiceProtocol protocol;  ///< Probe that was run.
+    PortStatus status;         ///< Connect result; a port that accepts but never answers the probe is OPEN.
+    bool identified;           ///< The service answered in its protocol.
+    const char* banner;        ///< Identification text; points into the connection's buffer and is only valid during the callback.
+    std::size_t banner_len;    ///< Length of banner (not NUL-terminated).
+    CertInfo cert;             ///< Peer certificate for TLS probes.
+};
+
+/**
+ * @brief Connects and identifies services on one connection per port.
+ *
+ * The protocol stages run as a ConnectHook on a ScanEngine, so probes share
+ * its rate limit, congestion window, per-target RTT estimates and io_uring
+ * backend. Once connected, each probe sends an optional request and reads
+ * the reply, or runs a TLS handshake on the same socket. Replies are read
+ * into a fixed buffer per engine slot; a TLS probe additionally allocates
+ * its SSL object, always for a full handshake (see TlsContext). One
+ * deadline covers the whole pipeline; a connect that never completes is
+ * FILTERED, while a service that accepts but then stays silent is OPEN and
+ * unidentified.
+ */
+class ServiceProber : private ConnectHook {
+public:
+    using ResultCallback = std::function<void(const ServiceResult&)>;
+    using RefillCallback = ScanEngine::RefillCallback;
+
+    explicit ServiceProber(const ServiceProberOptions& options = ServiceProberOptions());
+    ~ServiceProber();
+
+    ServiceProber(const ServiceProber&) = delete;
+    ServiceProber& operator=(const ServiceProber&) = delete;
+
+    /**
+     * @brief Registers a resolved target.
+     * @param host Hostname, used for SNI and reporting.
+     * @param addr Resolved socket address; the port field is overwritten per probe.
+     * @param addr_len Length of addr.
+     * @param rtt Estimate carried over from earlier runs (see TargetCache::rtt()).
+     * @return Target index to pass to submit().
+     */
+    std::size_t add_target(const std::string& host, const sockaddr_storage& addr, socklen_t addr_len,
+                           const RttEstimator& rtt = RttEstimator());
+
+    /** @brief RTT estimate for a target, including samples from earlier runs. */
+    const RttEstimator& target_rtt(std::size_t target) const { return engine_.target_rtt(target); }
+
+    /**
+     * @brief Queues a probe; nothing is sent until run() is called.
+     * @param target Index returned by add_target().
+     * @param port TCP port.
+     * @param protocol Protocol to check for once connected.
+     */
+    void submit(std::size_t target, int port, ServiceProtocol protocol);
+
+    /**
+     * @brief Drives all queued probes to completion.
+     *
+     * May be called again with more probes; targets and their RTT estimates
+     * are kept between runs.
+     * @param on_result Invoked once per submitted probe.
+     * @param refill Optional source of further probes (see ScanEngine::run()).
+     * @return false if the event loop failed, or the TLS context could not be
+     *         created while TLS probes are queued.
+     */
+    bool run(const ResultCallback& on_result, const RefillCallback& refill = RefillCallback());
+
+    /** @brief True if probes go through io_uring rather than epoll. */
+    bool using_io_uring() const { return engine_.using_io_uring(); }
+
+private:
+    enum class Stage { SENDING, READING, HANDSHAKING, DONE };
+
+    /// Protocol state for the connection in one engine slot.
+    struct Conn {
+        int fd = -1;
+        SSL* ssl = nullptr;
+        Stage stage = Stage::DONE;
+        ServiceProtocol protocol = ServiceProtocol::NONE;
+        std::size_t target = 0;
+        int port = 0;
+        uint64_t phase_start_us = 0;  ///< Start of the current phase, for metrics.
+        std::size_t sent = 0;         ///< Request bytes written so far.
+        std::size_t len = 0;          ///< Reply bytes in buf.
+        bool identified = false;
+        const char* banner = nullptr; ///< buf, or the TLS version string.
+        CertInfo cert;
+        char buf[kServiceBufferSize];
+    };
+
+    uint32_t start(uint32_t slot, int fd, std::size_t target, int port, uint64_t tag) override;
+    uint32_t resume(uint32_t slot) override;
+    void finish(uint32_t slot) override;
+
+    uint32_t drive_send(Conn& c);
+    uint32_t drive_read(Conn& c);
+    uint32_t drive_handshake(Conn& c);
+    void identify_tls(Conn& c);
+
+    ScanEngine engine_;
+    std::vector<Conn> conns_;
+    Conn* finished_;   ///< Connection whose session just ended; its result is emitted next.
+    bool tls_queued_;
+};
@@ -0,0 +1,221 @@
+#include "sharded_scanner.h"
+#include "scan_journal.h"
+#include <thread>
+#include <unordered_map>
+
+ShardedScanner::ShardedScanner(const std::vector<HostEntry>& hosts, const std::vector<int>& ports,
+                               const ShardedScanOptions& options)
+    : hosts_(hosts),
+      ports_(ports),
+      options_(options),
+      order_(options.order ? *options.order : TargetOrder(hosts.size(), ports)),
+      total_(static_cast<std::size_t>(order_.positions())),
+      chunk_size_(1),
+      num_chunks_(0),
+      threads_(options.threads) {
+    if (threads_ == 0) {
+        threads_ = std::thread::hardware_concurrency();
+        if (threads_ == 0) threads_ = 1;
+    }
+
+    if (options_.journal) {
+        chunk_size_ = options_.journal->chunk_size();
+    } else if (options_.chunk_size) {
+        chunk_size_ = options_.chunk_size;
+    } else {
+        chunk_size_ = default_chunk_size(total_, threads_, options_.min_chunk);
+    }
+    num_chunks_ = (total_ + chunk_size_ - 1) / chunk_size_;
+
+    chunks_.reset(new Chunk[num_chunks_ ? num_chunks_ : 1]);
+    std::vector<std::size_t> pending;
+    for (std::size_t c = 0; c < num_chunks_; ++c) {
+        if (options_.journal && options_.journal->chunk_done(c)) {
+            chunks_[c].resumed = true;
+            chunks_[c].done.store(true, std::memory_order_relaxed);
+        } else {
+            pending.push_back(c);
+        }
+    }
+    if (threads_ > pending.size()) threads_ = pending.empty() ? 1 : static_cast<unsigned>(pending.size());
+
+    queues_.reset(new WorkerQueue[threads_]);
+    // Round-robin dealing keeps every worker near the front of the matrix,
+    // which keeps the in-order merge buffer small.
+    for (std::size_t k = 0; k < pending.size(); ++k) {
+        queues_[k % threads_].chunks.push_back(pending[k]);
+    }
+}
+
+std::size_t ShardedScanner::default_chunk_size(std::size_t total, unsigned threads, std::size_t min_chunk) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+    // Aim for plenty of chunks per worker so stealing can balance the tail,
+    // without letting the chunk table itself grow with the matrix size.
+    std::size_t target_chunks = static_cast<std::size_t>(threads) * 64;
+    std::size_t chunk_size = (total + target_chunks - 1) / target_chunks;
+    if (chunk_size < min_chunk) chunk_size = min_chunk;
+    // An empty matrix with min_chunk 0 would otherwise yield 0, which the
+    // caller divides by.
+    if (chunk_size < 4) chunk_size = 4;
+    return (chunk_size + 3) & ~std::size_t(3);
+}
+
+/**
+ * @brief Takes the next chunk for a worker: own deque first, then steal.
+ * @param worker Worker index.
+ * @param chunk Output chunk id.
+ * @return false once every deque is empty.
+ */
+bool ShardedScanner::take_chunk(unsigned worker, std::size_t& chunk) {
+    {
+        WorkerQueue& own = queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < threads_; ++i) {
+        WorkerQueue& victim = queues_[(worker + i) % threads_];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Records count finished probes in chunk c, checkpoints it once complete
+ *        and wakes the merger.
+ */
+void ShardedScanner::complete(std::size_t c, std::size_t count) {
+    Chunk& chunk = chunks_[c];
+    if (chunk.remaining.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        if (options_.journal) {
+            options_.journal->commit_chunk(c, chunk.status);
+        }
+        chunk.done.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        done_cv_.notify_all();
+    }
+}
+
+/**
+ * @brief Worker body: one ScanEngine fed chunk by chunk until no work is left.
+ * @return false if the engine's event loop failed.
+ */
+bool ShardedScanner::worker_main(unsigned worker) {
+    ScanEngineOptions engine_options = options_.engine;
+    engine_options.max_in_flight = clamp_to_fd_limit(options_.engine.max_in_flight) / threads_;
+    if (engine_options.max_in_flight == 0) engine_options.max_in_flight = 1;
+    engine_options.initial_window = (options_.engine.initial_window + threads_ - 1) / threads_;
+    engine_options.rate_limit = options_.engine.rate_limit / threads_;
+    ScanEngine engine(engine_options);
+
+    std::unordered_map<std::size_t, std::size_t> host_target;
+    const std::size_t nports = ports_.size();
+
+    auto refill = [&]() -> bool {
+        std::size_t c;
+        if (!take_chunk(worker, c)) {
+            return false;
+        }
+        Chunk& chunk = chunks_[c];
+        std::size_t begin = c * chunk_size_;
+        std::size_t end = begin + chunk_size_ < total_ ? begin + chunk_size_ : total_;
+        chunk.status.assign(end - begin, static_cast<uint8_t>(PortStatus::CLOSED));
+        chunk.remaining.store(end - begin, std::memory_order_relaxed);
+
+        // Positions that map to no probe (gaps in a randomized order) count as done.
+        std::size_t unprobed = end - begin;
+        TargetOrder::Cursor cursor = order_.range(begin, end);
+        uint64_t position, index;
+        while (cursor.next(position, index)) {
+            std::size_t h = static_cast<std::size_t>(index / nports);
+            int port = ports_[index % nports];
+            const HostEntry& host = hosts_[h];
+            PortStatus known_status;
+            if (host.addr.family == AF_UNSPEC) {
+                continue;
+            }
+            if (options_.known && options_.known(host, port, known_status)) {
+                chunk.status[position - begin] = static_cast<uint8_t>(known_status);
+                continue;
+            }
+            auto it = host_target.find(h);
+            if (it == host_target.end()) {
+                sockaddr_storage addr;
+                socklen_t addr_len = host.addr.to_sockaddr(0, addr);
+                it = host_target.emplace(h, engine.add_target(host.name, addr, addr_len)).first;
+            }
+            engine.submit(it->second, port, position);
+            --unprobed;
+        }
+        if (unprobed > 0) {
+            complete(c, unprobed);
+        }
+        return true;
+    };
+
+    auto on_result = [&](const ScanResult& r) {
+        std::size_t position = static_cast<std::size_t>(r.tag);
+        chunks_[position / chunk_size_].status[position % chunk_size_] = static_cast<uint8_t>(r.status);
+        complete(position / chunk_size_, 1);
+    };
+
+    if (!engine.run(on_result, refill)) {
+        // Unblock the merger; chunks this worker held will never complete.
+        failed_.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        done_cv_.notify_all();
+        return false;
+    }
+    return true;
+}
+
+bool ShardedScanner::run(const EmitCallback& emit) {
+    std::vector<std::thread> workers;
+    std::unique_ptr<bool[]> ok(new bool[threads_]);
+    for (unsigned w = 0; w < threads_; ++w) {
+        ok[w] = true;
+        workers.emplace_back([this, w, &ok]() { ok[w] = worker_main(w); });
+    }
+
+    const std::size_t nports = ports_.size();
+    for (std::size_t c = 0; c < num_chunks_; ++c) {
+        Chunk& chunk = chunks_[c];
+        if (!chunk.done.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(done_mutex_);
+            done_cv_.wait(lock, [this, &chunk]() {
+                return chunk.done.load(std::memory_order_acquire) || failed_.load(std::memory_order_acquire);
+            });
+            if (!chunk.done.load(std::memory_order_acquire)) {
+                break;
+            }
+        }
+        std::size_t begin = c * chunk_size_;
+        std::size_t end = begin + chunk_size_ < total_ ? begin + chunk_size_ : total_;
+        TargetOrder::Cursor cursor = order_.range(begin, end);
+        uint64_t position, index;
+        while (cursor.next(position, index)) {
+            PortStatus status = chunk.resumed ? options_.journal->status(static_cast<std::size_t>(position))
+                                              : static_cast<PortStatus>(chunk.status[position - begin]);
+            emit(hosts_[index / nports], ports_[index % nports], status);
+        }
+        std::vector<uint8_t>().swap(chunk.status);
+    }
+
+    bool all_ok = true;
+    for (unsigned w = 0; w < threads_; ++w) {
+        workers[w].join();
+        all_ok = all_ok && ok[w];
+    }
+    return all_ok;
+}
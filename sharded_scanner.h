@@ -0,0 +1,105 @@
+#pragma once
+#include "scan_engine.h"
+#include "target_spec.h"
+#include "target_order.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ScanJournal;
+
+/**
+ * @brief Tunables for the multi-threaded scheduler.
+ */
+struct ShardedScanOptions {
+    unsigned threads = 0;          ///< Worker threads; 0 means one per core.
+    std::size_t min_chunk = 256;   ///< Smallest number of (host, port) probes per chunk.
+    std::size_t chunk_size = 0;    ///< Exact probes per chunk; 0 derives it from threads and min_chunk.
+    ScanJournal* journal = nullptr; ///< Checkpoint to resume from and commit finished chunks to (not owned).
+    const TargetOrder* order = nullptr; ///< Probe order and shard (copied); nullptr scans host by host.
+    /// Supplies a result without probing (e.g. one already measured); may be called from any worker.
+    std::function<bool(const HostEntry& host, int port, PortStatus& status)> known;
+    ScanEngineOptions engine;      ///< Engine settings; max_in_flight, initial_window and rate_limit are totals split across workers.
+};
+
+/**
+ * @brief Multi-core scheduler over a hosts x ports matrix.
+ *
+ * The positions of a TargetOrder (host-major by default) are cut into
+ * fixed-size chunks and dealt round-robin to per-worker deques. Each worker runs its own ScanEngine event
+ * loop, pulling the next chunk from the front of its own deque whenever its
+ * queue runs dry and stealing from the back of a peer's deque once its own is
+ * empty. Results are written into the owning chunk without locking; the
+ * calling thread emits chunks strictly in order as they complete, so output
+ * follows the scan order (host/port order unless randomized) regardless of
+ * which worker scanned what.
+ *
+ * With a journal, every finished chunk is checkpointed; chunks the journal
+ * already holds are not dealt out again and are emitted from the journal.
+ */
+class ShardedScanner {
+public:
+    using EmitCallback = std::function<void(const HostEntry& host, int port, PortStatus status)>;
+
+    /**
+     * @param hosts Targets to scan; entries with family AF_UNSPEC are reported CLOSED without probing.
+     * @param ports Ports to probe on every host.
+     * @param options Scheduler and engine settings.
+     */
+    ShardedScanner(const std::vector<HostEntry>& hosts, const std::vector<int>& ports,
+                   const ShardedScanOptions& options = ShardedScanOptions());
+
+    /**
+     * @brief Scans everything and emits results in order from the calling thread.
+     * @param emit Invoked once per (host, port).
+     * @return false if any worker's event loop failed.
+     */
+    bool run(const EmitCallback& emit);
+
+    /**
+     * @brief Chunk size the scheduler picks when ShardedScanOptions::chunk_size is 0.
+     * @param total Number of positions in the scan's TargetOrder.
+     * @param threads Worker threads; 0 means one per core.
+     * @param min_chunk Lower bound on the chunk size.
+     * @return A multiple of 4 and at least 4, so a journal can store each chunk in
+     *         whole bytes.
+     */
+    static std::size_t default_chunk_size(std::size_t total, unsigned threads, std::size_t min_chunk);
+
+private:
+    struct Chunk {
+        std::vector<uint8_t> status;          ///< PortStatus per position; written only by the owning worker.
+        std::atomic<std::size_t> remaining{0};
+        std::atomic<bool> done{false};
+        bool resumed = false;                 ///< Finished in an earlier run; results are in the journal.
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::size_t> chunks;
+    };
+
+    bool take_chunk(unsigned worker, std::size_t& chunk);
+    void complete(std::size_t c, std::size_t count);
+    bool worker_main(unsigned worker);
+
+    const std::vector<HostEntry>& hosts_;
+    const std::vector<int>& ports_;
+    ShardedScanOptions options_;
+    TargetOrder order_;
+    std::size_t total_;
+    std::size_t chunk_size_;
+    std::size_t num_chunks_;
+    unsigned threads_;
+    std::unique_ptr<Chunk[]> chunks_;
+    std::unique_ptr<WorkerQueue[]> queues_;
+    std::atomic<bool> failed_{false};
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+};
@@ -0,0 +1,369 @@
+#include "syn_scanner.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+/**
+ * @brief splitmix64 finaliser, used as a fast keyed mixing function.
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Internet checksum over a buffer, continuing from a partial sum.
+ */
+static uint32_t checksum_add(uint32_t sum, const void* data, std::size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (len > 1) {
+        sum += static_cast<uint32_t>(p[0]) << 8 | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len) sum += static_cast<uint32_t>(p[0]) << 8;
+    return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum) {
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return htons(static_cast<uint16_t>(~sum));
+}
+
+/**
+ * @brief Finds the local address the kernel would use to reach daddr.
+ * @return Source address in network byte order, or 0 on failure.
+ */
+static uint32_t route_source(uint32_t daddr) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    sockaddr_in dst;
+    std::memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(9);
+    dst.sin_addr.s_addr = daddr;
+    uint32_t saddr = 0;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&dst), sizeof(dst)) == 0) {
+        sockaddr_in local;
+        socklen_t len = sizeof(local);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&local), &len) == 0) {
+            saddr = local.sin_addr.s_addr;
+        }
+    }
+    close(fd);
+    return saddr;
+}
+
+SynScanner::SynScanner(const SynScanOptions& options)
+    : options_(options),
+      raw_fd_(-1),
+      reserve_fd_(-1),
+      sport_(0),
+      secret_(0),
+      outstanding_(0),
+      round_start_ms_(0),
+      limiter_(options.rate_limit, options.rate_limit / 10.0) {
+    std::random_device rd;
+    secret_ = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+}
+
+SynScanner::~SynScanner() {
+    if (raw_fd_ >= 0) close(raw_fd_);
+    if (reserve_fd_ >= 0) close(reserve_fd_);
+}
+
+bool SynScanner::open() {
+    raw_fd_ = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (raw_fd_ < 0) {
+        std::cerr << "Error: raw socket unavailable (SYN scan needs CAP_NET_RAW) - "
+                  << std::strerror(errno) << "\n";
+        return false;
+    }
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(raw_fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    // Reserve a source port so no local connection can collide with our probes.
+    reserve_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    socklen_t len = sizeof(local);
+    if (reserve_fd_ < 0 ||
+        bind(reserve_fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0 ||
+        getsockname(reserve_fd_, reinterpret_cast<sockaddr*>(&local), &len) < 0) {
+        std::cerr << "Error: could not reserve a source port - " << std::strerror(errno) << "\n";
+        return false;
+    }
+    sport_ = ntohs(local.sin_port);
+    return true;
+}
+
+std::size_t SynScanner::add_target(const std::string& host, const TargetAddress& addr) {
+    Target t;
+    t.host = host;
+    std::memcpy(&t.daddr, addr.bytes, 4);
+    t.saddr = route_source(t.daddr);
+    targets_.push_back(t);
+    by_addr_.emplace(t.daddr, targets_.size() - 1);
+    return targets_.size() - 1;
+}
+
+void SynScanner::set_ports(const std::vector<int>& ports) {
+    ports_ = ports;
+    port_index_.assign(65536, -1);
+    for (std::size_t i = 0; i < ports_.size(); ++i) {
+        port_index_[static_cast<uint16_t>(ports_[i])] = static_cast<int32_t>(i);
+    }
+    sent_.assign(targets_.size() * ports_.size(), false);
+    answered_.assign(targets_.size() * ports_.size(), false);
+}
+
+/**
+ * @brief Keyed hash used as the SYN's initial sequence number.
+ */
+uint32_t SynScanner::cookie(uint32_t daddr, uint16_t dport, uint16_t sport) const {
+    uint64_t v = (static_cast<uint64_t>(daddr) << 32) | (static_cast<uint64_t>(dport) << 16) | sport;
+    return static_cast<uint32_t>(mix64(v ^ secret_));
+}
+
+/**
+ * @brief Builds and transmits one SYN segment (with an MSS option).
+ * @return FULL if the socket buffer had no room (nothing was sent), FAILED on
+ *         any other error.
+ */
+SynScanner::SendResult SynScanner::send_syn(const Target& t, uint16_t port) {
+    uint8_t segment[24];
+    std::memset(segment, 0, sizeof(segment));
+    tcphdr* tcp = reinterpret_cast<tcphdr*>(segment);
+    tcp->source = htons(sport_);
+    tcp->dest = htons(port);
+    tcp->seq = htonl(cookie(t.daddr, port, sport_));
+    tcp->doff = sizeof(segment) / 4;
+    tcp->syn = 1;
+    tcp->window = htons(1024);
+    segment[20] = 2;    // MSS option kind
+    segment[21] = 4;    // option length
+    segment[22] = 0x05; // 1460
+    segment[23] = 0xb4;
+
+    // Pseudo-header: source, destination, zero, protocol, TCP length.
+    uint8_t pseudo[12];
+    std::memcpy(pseudo, &t.saddr, 4);
+    std::memcpy(pseudo + 4, &t.daddr, 4);
+    pseudo[8] = 0;
+    pseudo[9] = IPPROTO_TCP;
+    pseudo[10] = 0;
+    pseudo[11] = sizeof(segment);
+    uint32_t sum = checksum_add(0, pseudo, sizeof(pseudo));
+    sum = checksum_add(sum, segment, sizeof(segment));
+    tcp->check = checksum_fold(sum);
+
+    sockaddr_in dst;
+    std::memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    dst.sin_addr.s_addr = t.daddr;
+    if (sendto(raw_fd_, segment, sizeof(segment), 0, reinterpret_cast<sockaddr*>(&dst), sizeof(dst)) < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ? SendResult::FULL : SendResult::FAILED;
+    }
+    return SendResult::SENT;
+}
+
+/**
+ * @brief Drains the raw socket, classifying valid SYN-ACK and RST replies.
+ */
+void SynScanner::receive(uint64_t now_ms, const ResultCallback& on_result) {
+    uint8_t buf[1500];
+    for (;;) {
+        ssize_t n = recv(raw_fd_, buf, sizeof(buf), 0);
+        if (n < 0) {
+            return;
+        }
+        if (n < static_cast<ssize_t>(sizeof(iphdr))) continue;
+        const iphdr* ip = reinterpret_cast<const iphdr*>(buf);
+        std::size_t ihl = ip->ihl * 4u;
+        if (ip->protocol != IPPROTO_TCP || n < static_cast<ssize_t>(ihl + sizeof(tcphdr))) continue;
+        const tcphdr* tcp = reinterpret_cast<const tcphdr*>(buf + ihl);
+        if (ntohs(tcp->dest) != sport_ || !(tcp->rst || (tcp->syn && tcp->ack))) continue;
+
+        uint16_t dport = ntohs(tcp->source);
+        uint32_t expected = cookie(ip->saddr, dport, sport_) + 1;
+        if (ntohl(tcp->ack_seq) != expected) {
+            continue; // not ours, or forged
+        }
+        int32_t port_index = port_index_[dport];
+        if (port_index < 0) continue;
+        PortStatus status = (tcp->syn && tcp->ack) ? PortStatus::OPEN : PortStatus::CLOSED;
+        auto range = by_addr_.equal_range(ip->saddr);
+        for (auto it = range.first; it != range.second; ++it) {
+            std::size_t bit = it->second * ports_.size() + static_cast<std::size_t>(port_index);
+            if (sent_[bit]) {
+                answer(bit, it->second, dport, status, static_cast<uint32_t>(now_ms - round_start_ms_), on_result);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reports a probe's result unless it was already reported.
+ */
+void SynScanner::answer(std::size_t bit, std::size_t target, int port, PortStatus status, uint32_t rtt_ms,
+                        const ResultCallback& on_result) {
+    if (answered_[bit]) {
+        return;
+    }
+    answered_[bit] = true;
+    --outstanding_;
+    metrics_count_status(status);
+    on_result(ScanResult{target, port, status, rtt_ms, 0});
+}
+
+bool SynScanner::run(const std::function<ProbeCursor()>& begin_round, const ResultCallback& on_result) {
+    if (raw_fd_ < 0) {
+        return false;
+    }
+    const std::size_t nports = ports_.size();
+    std::size_t target = 0, port_index = 0;
+    outstanding_ = 0;
+
+    for (uint32_t round = 0; round <= options_.retries && (round == 0 || outstanding_ > 0); ++round) {
+        ProbeCursor cursor = begin_round();
+        bool sending = true;
+        bool pending = false;  // (target, port_index) was pulled but not sent yet
+        round_start_ms_ = monotonic_ms();
+        uint64_t last_send = round_start_ms_;
+        for (;;) {
+            uint64_t now = monotonic_ms();
+            // Transmit as many SYNs as the rate limit and socket buffer allow,
+            // then service replies. A probe that hit a full buffer stays
+            // pending and is retried once poll() reports room.
+            std::size_t burst = 0;
+            bool full = false;
+            while (sending && burst < 256) {
+                if (!pending) {
+                    if (!cursor(target, port_index)) {
+                        sending = false;
+                        break;
+                    }
+                    pending = true;
+                }
+                std::size_t bit = target * nports + port_index;
+                if (answered_[bit]) {
+                    pending = false;
+                    continue;
+                }
+                if (!limiter_.try_acquire(now)) break;
+                SendResult sent = send_syn(targets_[target], static_cast<uint16_t>(ports_[port_index]));
+                if (sent == SendResult::FULL) {
+                    limiter_.refund();
+                    full = true;
+                    break;
+                }
+                if (sent == SendResult::FAILED) {
+                    std::cerr << "Error: sendto() failed - " << std::strerror(errno) << "\n";
+                    return false;
+                }
+                if (!sent_[bit]) {
+                    sent_[bit] = true;
+                    ++outstanding_;
+                }
+                pending = false;
+                last_send = now;
+                ++burst;
+            }
+
+            receive(now, on_result);
+            if (!sending && outstanding_ == 0) break;
+            if (!sending && now - last_send >= options_.timeout_ms) break;
+
+            // ENOBUFS (a full qdisc) can persist while POLLOUT is already
+            // set, so a full buffer is waited on for at most 10 ms at a time.
+            int wait_ms = full      ? 10
+                          : sending ? static_cast<int>(limiter_.wait_ms(now))
+                                    : static_cast<int>(options_.timeout_ms - (now - last_send));
+            struct pollfd pfd = {raw_fd_, static_cast<short>(full ? POLLIN | POLLOUT : POLLIN), 0};
+            if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+                std::cerr << "Error: poll() failed - " << std::strerror(errno) << "\n";
+                return false;
+            }
+        }
+    }
+
+    ProbeCursor cursor = begin_round();
+    while (outstanding_ > 0 && cursor(target, port_index)) {
+        std::size_t bit = target * nports + port_index;
+        if (sent_[bit]) {
+            answer(bit, target, ports_[port_index], PortStatus::FILTERED, options_.timeout_ms, on_result);
+        }
+    }
+    outstanding_ = 0;
+    return true;
+}
+
+bool syn_scan(const std::vector<HostEntry>& hosts, const std::vector<int>& ports, const TargetOrder& order,
+              const SynScanOptions& options,
+              const std::function<void(const HostEntry& host, int port, PortStatus status)>& emit) {
+    SynScanner scanner(options);
+    if (!scanner.open()) {
+        return false;
+    }
+
+    const std::size_t nports = ports.size();
+    const std::size_t kNoTarget = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> target_host;
+    std::vector<std::size_t> host_target(hosts.size(), kNoTarget);
+    for (std::size_t h = 0; h < hosts.size(); ++h) {
+        if (hosts[h].addr.family != AF_INET) {
+            if (hosts[h].addr.family == AF_INET6) {
+                std::cerr << "Error: SYN scan supports IPv4 only; skipping " << hosts[h].name << "\n";
+            }
+            continue;
+        }
+        host_target[h] = scanner.add_target(hosts[h].name, hosts[h].addr);
+        target_host.push_back(h);
+    }
+    scanner.set_ports(ports);
+    uint64_t position, index;
+    if (target_host.size() < hosts.size()) {
+        // Hosts that cannot be SYN-scanned are reported up front.
+        TargetOrder::Cursor cursor = order.range(0, order.positions());
+        while (cursor.next(position, index)) {
+            std::size_t h = static_cast<std::size_t>(index / nports);
+            if (host_target[h] == kNoTarget) {
+                emit(hosts[h], ports[index % nports], PortStatus::CLOSED);
+            }
+        }
+    }
+
+    // SYNs go out in the order's sequence, so a randomized order spreads
+    // them across hosts rather than sweeping one host at a time. Each round
+    // regenerates the sequence instead of storing it.
+    auto begin_round = [&]() -> SynScanner::ProbeCursor {
+        TargetOrder::Cursor cursor = order.range(0, order.positions());
+        return [&, cursor](std::size_t& target, std::size_t& port_index) mutable {
+            uint64_t at, probe;
+            while (cursor.next(at, probe)) {
+                std::size_t t = host_target[probe / nports];
+                if (t != kNoTarget) {
+                    target = t;
+                    port_index = static_cast<std::size_t>(probe % nports);
+                    return true;
+                }
+            }
+            return false;
+        };
+    };
+    return scanner.run(begin_round,
+                       [&](const ScanResult& r) { emit(hosts[target_host[r.target]], r.port, r.status); });
+}
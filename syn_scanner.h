@@ -0,0 +1,139 @@
+#pragma once
+#include "scan_engine.h"
+#include "rate_control.h"
+#include "resolver.h"
+#include "target_spec.h"
+#include "target_order.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Tunables for the raw-socket SYN scanner.
+ */
+struct SynScanOptions {
+    uint32_t timeout_ms = 3000;  ///< Wait for replies after the last SYN of a round.
+    uint32_t retries = 1;        ///< Extra SYNs sent to probes that stayed silent.
+    double rate_limit = 0.0;     ///< SYNs per second; 0 = unlimited.
+};
+
+/**
+ * @brief Half-open ("SYN") scanner for IPv4 targets.
+ *
+ * One transmit path crafts TCP SYNs on a raw socket; one receive path reads
+ * every inbound TCP segment from the same socket and classifies SYN-ACK as
+ * OPEN and RST as CLOSED. Probes that stay silent through every retry are
+ * FILTERED. The kernel answers each SYN-ACK with a RST because no socket owns
+ * the connection, so no handshake is completed and no local port or
+ * TIME_WAIT slot is consumed per probe.
+ *
+ * Replies are validated statelessly: the initial sequence number is a keyed
+ * hash of (target address, target port, source port), so a genuine reply
+ * acknowledges hash + 1 and forged or stale segments are dropped without a
+ * lookup. A validated reply is mapped by (address, port) to a bit in a
+ * targets x ports bitmap, so per-probe state is two bits; probes are pulled
+ * from a cursor as they are sent, so nothing is queued. Requires CAP_NET_RAW.
+ */
+class SynScanner {
+public:
+    using ResultCallback = std::function<void(const ScanResult&)>;
+
+    /// Yields the next probe as (target, port index); returns false once the round is complete.
+    using ProbeCursor = std::function<bool(std::size_t& target, std::size_t& port_index)>;
+
+    explicit SynScanner(const SynScanOptions& options = SynScanOptions());
+    ~SynScanner();
+
+    SynScanner(const SynScanner&) = delete;
+    SynScanner& operator=(const SynScanner&) = delete;
+
+    /**
+     * @brief Opens the raw socket and reserves a source port.
+     * @return false if raw sockets are unavailable (an error is printed).
+     */
+    bool open();
+
+    /**
+     * @brief Registers an IPv4 target.
+     * @param host Hostname, kept for reporting.
+     * @param addr Resolved address; must be AF_INET.
+     * @return Target index for the probe cursor.
+     */
+    std::size_t add_target(const std::string& host, const TargetAddress& addr);
+
+    /** @brief Hostname registered for a target index. */
+    const std::string& target_host(std::size_t target) const { return targets_[target].host; }
+
+    /**
+     * @brief Sets the ports that probe cursors index into; call after every add_target().
+     * @param ports TCP ports, without duplicates.
+     */
+    void set_ports(const std::vector<int>& ports);
+
+    /**
+     * @brief Sends a SYN for every probe a cursor yields and reports each probe exactly once.
+     *
+     * Probes are pulled from the cursor as the rate limit and socket buffer
+     * allow, so nothing is queued ahead of sending. OPEN and CLOSED results
+     * are emitted as replies arrive, with rtt_ms measured from the start of
+     * the round; FILTERED results are emitted after the final round's timeout.
+     * @param begin_round Returns a cursor over the probes, yielding the same
+     *        probes on every call; called once per round and once more to
+     *        report FILTERED probes.
+     * @param on_result Invoked once per probe.
+     * @return false if the raw socket failed.
+     */
+    bool run(const std::function<ProbeCursor()>& begin_round, const ResultCallback& on_result);
+
+private:
+    struct Target {
+        std::string host;
+        uint32_t daddr;   ///< Network byte order.
+        uint32_t saddr;   ///< Local address used to reach daddr, network byte order.
+    };
+
+    enum class SendResult { SENT, FULL, FAILED };
+
+    uint32_t cookie(uint32_t daddr, uint16_t dport, uint16_t sport) const;
+    SendResult send_syn(const Target& target, uint16_t port);
+    void receive(uint64_t now_ms, const ResultCallback& on_result);
+    void answer(std::size_t bit, std::size_t target, int port, PortStatus status, uint32_t rtt_ms,
+                const ResultCallback& on_result);
+
+    SynScanOptions options_;
+    int raw_fd_;
+    int reserve_fd_;
+    uint16_t sport_;
+    uint64_t secret_;
+    std::vector<Target> targets_;
+    std::unordered_multimap<uint32_t, std::size_t> by_addr_;  ///< daddr -> targets (a host may be listed twice)
+    std::vector<int> ports_;
+    std::vector<int32_t> port_index_;  ///< TCP port -> index into ports_, -1 if not scanned.
+    std::vector<bool> sent_;           ///< One bit per target x port.
+    std::vector<bool> answered_;       ///< One bit per target x port.
+    std::size_t outstanding_;
+    uint64_t round_start_ms_;
+    TokenBucket limiter_;
+};
+
+/**
+ * @brief Runs a SYN scan over a hosts x ports matrix.
+ *
+ * SYNs are sent in the order's sequence, generated lazily from
+ * TargetOrder::range(), and only the order's shard is scanned; OPEN and CLOSED results are emitted as replies arrive, FILTERED
+ * ones after the last retry. IPv6 and unresolved hosts cannot be SYN-scanned
+ * and their ports are reported CLOSED; IPv6 hosts get a note on stderr here,
+ * unresolved ones were already reported by the resolver.
+ * @param hosts Targets to scan.
+ * @param ports Ports to probe on every host.
+ * @param order Probe order and shard over hosts x ports.
+ * @param options Scanner settings.
+ * @param emit Invoked once per (host, port) in the shard.
+ * @return false if the raw socket could not be opened or failed.
+ */
+bool syn_scan(const std::vector<HostEntry>& hosts, const std::vector<int>& ports, const TargetOrder& order,
+              const SynScanOptions& options,
+              const std::function<void(const HostEntry& host, int port, PortStatus status)>& emit);
@@ -0,0 +1,207 @@
+#include "target_order.h"
+#include <algorithm>
+
+namespace {
+
+__extension__ typedef unsigned __int128 uint128;
+
+uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t m) {
+    return static_cast<uint64_t>(static_cast<uint128>(a) * b % m);
+}
+
+uint64_t pow_mod(uint64_t base, uint64_t exp, uint64_t m) {
+    uint64_t result = 1 % m;
+    base %= m;
+    while (exp > 0) {
+        if (exp & 1) result = mul_mod(result, base, m);
+        base = mul_mod(base, base, m);
+        exp >>= 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Deterministic Miller-Rabin; these bases are exact for every 64-bit n.
+ */
+bool is_prime(uint64_t n) {
+    static const uint64_t kBases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if (n < 2) return false;
+    for (uint64_t b : kBases) {
+        if (n % b == 0) return n == b;
+    }
+    uint64_t d = n - 1;
+    unsigned r = 0;
+    while ((d & 1) == 0) {
+        d >>= 1;
+        ++r;
+    }
+    for (uint64_t b : kBases) {
+        uint64_t x = pow_mod(b, d, n);
+        if (x == 1 || x == n - 1) continue;
+        bool composite = true;
+        for (unsigned i = 1; i < r && composite; ++i) {
+            x = mul_mod(x, x, n);
+            composite = x != n - 1;
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Distinct prime factors of n by trial division (n is at most a few
+ *        times 2^40 here, so this stays in the low milliseconds).
+ */
+std::vector<uint64_t> prime_factors(uint64_t n) {
+    std::vector<uint64_t> factors;
+    for (uint64_t f = 2; f * f <= n; f += (f == 2 ? 1 : 2)) {
+        if (n % f == 0) {
+            factors.push_back(f);
+            while (n % f == 0) n /= f;
+        }
+    }
+    if (n > 1) factors.push_back(n);
+    return factors;
+}
+
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+} // namespace
+
+TargetOrder::TargetOrder(std::size_t hosts, const std::vector<int>& ports, const TargetOrderOptions& options)
+    : nports_(ports.size()), positions_(0), fingerprint_(0) {
+    const unsigned shards = options.shards ? options.shards : 1;
+    const unsigned shard = options.shard < shards ? options.shard : shards - 1;
+
+    // Tier 0: priority ports in the order given; tier 1: everything else.
+    std::vector<bool> taken(ports.size(), false);
+    Tier priority = Tier();
+    for (int port : options.priority_ports) {
+        for (std::size_t i = 0; i < ports.size(); ++i) {
+            if (ports[i] == port && !taken[i]) {
+                taken[i] = true;
+                priority.ports.push_back(static_cast<int32_t>(i));
+            }
+        }
+    }
+    Tier rest = Tier();
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+        if (!taken[i]) rest.ports.push_back(static_cast<int32_t>(i));
+    }
+
+    uint64_t state = options.seed;
+    for (Tier* tier : {&priority, &rest}) {
+        tier->size = static_cast<uint64_t>(hosts) * tier->ports.size();
+        if (tier->size == 0) {
+            continue;
+        }
+        uint64_t cycle = tier->size;
+        if (options.randomize) {
+            // Smallest prime p > size: the group (Z/pZ)* has p - 1 >= size elements.
+            uint64_t p = tier->size + 1;
+            while (!is_prime(p)) ++p;
+            tier->prime = p;
+            cycle = p - 1;
+            if (p <= 3) {
+                tier->generator = p - 1;
+            } else {
+                // g generates the group iff g^((p-1)/q) != 1 for every prime q | p-1.
+                std::vector<uint64_t> factors = prime_factors(p - 1);
+                for (;;) {
+                    uint64_t g = 2 + splitmix64(state) % (p - 3);
+                    bool generator = true;
+                    for (uint64_t q : factors) {
+                        if (pow_mod(g, (p - 1) / q, p) == 1) {
+                            generator = false;
+                            break;
+                        }
+                    }
+                    if (generator) {
+                        tier->generator = g;
+                        break;
+                    }
+                }
+            }
+            tier->start = 1 + splitmix64(state) % (p - 1);
+        }
+        // Shard s takes the s-th of `shards` near-equal contiguous slices.
+        uint64_t base = cycle / shards;
+        uint64_t extra = cycle % shards;
+        tier->begin = base * shard + std::min<uint64_t>(shard, extra);
+        tier->length = base + (shard < extra ? 1 : 0);
+        tier->offset = positions_;
+        positions_ += tier->length;
+        tiers_.push_back(*tier);
+    }
+
+    if (options.randomize || shards > 1 || !priority.ports.empty()) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto mix = [&h](uint64_t v) {
+            h ^= v;
+            h *= 0x100000001b3ULL;
+        };
+        mix(options.randomize ? options.seed : 0);
+        mix(options.randomize ? 1 : 0);
+        mix(shard);
+        mix(shards);
+        for (int32_t i : priority.ports) mix(static_cast<uint64_t>(i));
+        fingerprint_ = h ? h : 1;
+    }
+}
+
+/**
+ * @brief Group element (randomized) or element index (sequential) at cycle position k.
+ */
+uint64_t TargetOrder::element(const Tier& tier, uint64_t k) const {
+    return tier.prime ? mul_mod(tier.start, pow_mod(tier.generator, k, tier.prime), tier.prime) : k;
+}
+
+TargetOrder::Cursor::Cursor(const TargetOrder& order, uint64_t begin, uint64_t end)
+    : order_(&order), pos_(begin), end_(std::min(end, order.positions_)), tier_(0), tier_end_(0), x_(0) {
+    seek();
+}
+
+/**
+ * @brief Finds the tier holding pos_ and computes its element directly.
+ */
+void TargetOrder::Cursor::seek() {
+    const std::vector<Tier>& tiers = order_->tiers_;
+    tier_ = 0;
+    while (tier_ < tiers.size() && pos_ >= tiers[tier_].offset + tiers[tier_].length) {
+        ++tier_;
+    }
+    if (tier_ == tiers.size()) {
+        tier_end_ = end_;
+        return;
+    }
+    const Tier& tier = tiers[tier_];
+    tier_end_ = tier.offset + tier.length;
+    x_ = order_->element(tier, tier.begin + (pos_ - tier.offset));
+}
+
+bool TargetOrder::Cursor::next(uint64_t& position, uint64_t& index) {
+    while (pos_ < end_) {
+        if (pos_ >= tier_end_) {
+            seek();
+            continue;
+        }
+        const Tier& tier = order_->tiers_[tier_];
+        // Element values are 1..p-1 in a group, 0..size-1 otherwise.
+        uint64_t value = tier.prime ? x_ - 1 : x_;
+        x_ = tier.prime ? mul_mod(x_, tier.generator, tier.prime) : x_ + 1;
+        uint64_t at = pos_++;
+        if (value >= tier.size) {
+            continue;
+        }
+        uint64_t nports = tier.ports.size();
+        position = at;
+        index = (value / nports) * order_->nports_ + static_cast<uint64_t>(tier.ports[value % nports]);
+        return true;
+    }
+    return false;
+}
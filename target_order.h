@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief How a hosts x ports scan is ordered and split.
+ */
+struct TargetOrderOptions {
+    bool randomize = false;          ///< Pseudo-random order instead of host by host, port by port.
+    uint64_t seed = 0;               ///< Permutation seed; every shard of one scan must use the same seed.
+    unsigned shard = 0;              ///< Slice scanned by this process, 0 <= shard < shards.
+    unsigned shards = 1;             ///< Number of disjoint slices the scan is split into.
+    std::vector<int> priority_ports; ///< Ports probed on every host before any other port.
+};
+
+/**
+ * @brief Stateless walk over a hosts x ports matrix.
+ *
+ * Probes are numbered host-major (host * ports + port index), as everywhere
+ * else in the scanner. TargetOrder maps a run of positions onto those
+ * indices without materialising the sequence: each position is computed from
+ * a handful of integers, so generating targets takes the same memory for a
+ * single host as for a /8.
+ *
+ * With randomize, the matrix is walked through the multiplicative group of
+ * integers modulo a prime p just above its size: position k visits
+ * start * g^k mod p for a generator g, and values past the matrix are skipped.
+ * Because g generates the whole group, every probe is visited exactly once,
+ * and consecutive probes land on unrelated hosts, which spreads load instead
+ * of working through one target's ports at a time.
+ *
+ * Priority ports form a first tier walked (and permuted) on its own, so they
+ * are probed on every host before the rest. Each tier's positions are cut
+ * into shards contiguous slices; shard i of N probes only its slice, and
+ * the N slices together cover the matrix exactly once.
+ */
+class TargetOrder {
+public:
+    /**
+     * @brief Iterates a range of positions, yielding the probes in it.
+     */
+    class Cursor {
+    public:
+        /**
+         * @brief Advances to the next probe in the range.
+         * @param position Position of the probe (see TargetOrder::positions()).
+         * @param index Host-major probe index, host * ports + port index.
+         * @return false once the range is exhausted.
+         */
+        bool next(uint64_t& position, uint64_t& index);
+
+    private:
+        friend class TargetOrder;
+        Cursor(const TargetOrder& order, uint64_t begin, uint64_t end);
+        void seek();
+
+        const TargetOrder* order_;
+        uint64_t pos_;
+        uint64_t end_;
+        std::size_t tier_;
+        uint64_t tier_end_;
+        uint64_t x_;        ///< Group element (randomized) or element index (sequential) at pos_.
+    };
+
+    /**
+     * @param hosts Number of hosts.
+     * @param ports Ports probed on every host, in index order.
+     * @param options Order, seed, shard and priority ports; priority ports
+     *        outside ports are ignored.
+     */
+    TargetOrder(std::size_t hosts, const std::vector<int>& ports,
+                const TargetOrderOptions& options = TargetOrderOptions());
+
+    /**
+     * @brief Number of positions in this shard.
+     *
+     * Randomized tiers include a few positions that map to no probe (the gap
+     * between the matrix size and the prime), so this can slightly exceed
+     * the number of probes.
+     */
+    uint64_t positions() const { return positions_; }
+
+    /**
+     * @brief Cursor over positions [begin, end).
+     */
+    Cursor range(uint64_t begin, uint64_t end) const { return Cursor(*this, begin, end); }
+
+    /**
+     * @brief Identifies the order and shard, for checkpoints.
+     * @return 0 for the plain host-major order over the whole matrix.
+     */
+    uint64_t fingerprint() const { return fingerprint_; }
+
+private:
+    struct Tier {
+        std::vector<int32_t> ports; ///< Port indices probed in this tier.
+        uint64_t size;              ///< hosts * ports.size().
+        uint64_t prime;             ///< Group modulus; 0 walks the tier sequentially.
+        uint64_t generator;
+        uint64_t start;             ///< Group element at cycle position 0.
+        uint64_t begin;             ///< First cycle position in this shard.
+        uint64_t length;            ///< Cycle positions in this shard.
+        uint64_t offset;            ///< Position of the tier's first entry in this shard.
+    };
+
+    uint64_t element(const Tier& tier, uint64_t k) const;
+
+    std::size_t nports_;
+    std::vector<Tier> tiers_;
+    uint64_t positions_;
+    uint64_t fingerprint_;
+};
@@ -0,0 +1,127 @@
+#include "target_spec.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+/**
+ * @brief Trims leading and trailing whitespace.
+ */
+static std::string trim(const std::string& s) {
+    std::size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return "";
+    std::size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+/**
+ * @brief Expands one CIDR block into numeric host entries.
+ * @param base Network address text.
+ * @param prefix_text Prefix length text.
+ * @param out Hosts appended in address order.
+ * @return false if the block is malformed or too large.
+ */
+static bool expand_cidr(const std::string& base, const std::string& prefix_text, std::vector<HostEntry>& out) {
+    char* end;
+    errno = 0;
+    long prefix = std::strtol(prefix_text.c_str(), &end, 10);
+    if (errno != 0 || end == prefix_text.c_str() || *end != '\0') {
+        std::cerr << "Error: '" << prefix_text << "' is not a valid prefix length.\n";
+        return false;
+    }
+
+    HostEntry entry;
+    int bits;
+    if (inet_pton(AF_INET, base.c_str(), entry.addr.bytes) == 1) {
+        entry.addr.family = AF_INET;
+        bits = 32;
+        if (prefix < 12 || prefix > 32) {
+            std::cerr << "Error: IPv4 prefix /" << prefix << " is out of range (/12-/32).\n";
+            return false;
+        }
+    } else if (inet_pton(AF_INET6, base.c_str(), entry.addr.bytes) == 1) {
+        entry.addr.family = AF_INET6;
+        bits = 128;
+        if (prefix < 108 || prefix > 128) {
+            std::cerr << "Error: IPv6 prefix /" << prefix << " is out of range (/108-/128).\n";
+            return false;
+        }
+    } else {
+        std::cerr << "Error: '" << base << "' is not a valid network address.\n";
+        return false;
+    }
+
+    // Host bits live in the last (at most 20) bits of the address.
+    int host_bits = bits - static_cast<int>(prefix);
+    int last = bits / 8 - 1;
+    uint32_t network = 0;
+    for (int i = 0; i < 4; ++i) {
+        network |= static_cast<uint32_t>(entry.addr.bytes[last - i]) << (8 * i);
+    }
+    uint32_t mask = host_bits >= 32 ? 0 : ~((1u << host_bits) - 1);
+    network &= mask;
+    uint64_t count = 1ull << host_bits;
+
+    out.reserve(out.size() + count);
+    for (uint64_t n = 0; n < count; ++n) {
+        uint32_t v = network | static_cast<uint32_t>(n);
+        for (int i = 0; i < 4; ++i) {
+            entry.addr.bytes[last - i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+        entry.name = entry.addr.to_string();
+        out.push_back(entry);
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a single target token (host, address or CIDR block).
+ */
+static bool parse_token(const std::string& token, std::vector<HostEntry>& out) {
+    std::size_t slash = token.find('/');
+    if (slash != std::string::npos) {
+        return expand_cidr(token.substr(0, slash), token.substr(slash + 1), out);
+    }
+    // Unresolvable names are kept with family AF_UNSPEC so that their ports
+    // are still reported (as CLOSED) rather than silently dropped.
+    HostEntry entry;
+    entry.name = token;
+    default_target_cache().lookup(token, entry.addr);
+    out.push_back(entry);
+    return true;
+}
+
+bool parse_targets(const std::string& spec, std::vector<HostEntry>& out) {
+    std::size_t pos = 0;
+    while (pos <= spec.size()) {
+        std::size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string token = trim(spec.substr(pos, comma - pos));
+        pos = comma + 1;
+        if (token.empty()) {
+            continue;
+        }
+
+        if (token[0] == '@') {
+            std::ifstream in(token.substr(1));
+            if (!in) {
+                std::cerr << "Error: cannot open target file '" << token.substr(1) << "'.\n";
+                return false;
+            }
+            std::string line;
+            while (std::getline(in, line)) {
+                std::size_t hash = line.find('#');
+                if (hash != std::string::npos) line.erase(hash);
+                line = trim(line);
+                if (!line.empty() && !parse_token(line, out)) {
+                    return false;
+                }
+            }
+        } else if (!parse_token(token, out)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "resolver.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief A scan target with its address already resolved.
+ */
+struct HostEntry {
+    std::string name;     ///< Name as given (or the numeric address for CIDR members).
+    TargetAddress addr;   ///< Address probed for this host.
+};
+
+/**
+ * @brief Expands a target specification into resolved hosts.
+ *
+ * Accepted forms, which may be mixed in a comma-separated list:
+ *   - a hostname or numeric IPv4/IPv6 address ("localhost", "::1")
+ *   - an IPv4 CIDR block ("10.0.0.0/16", prefix /12 or longer)
+ *   - an IPv6 CIDR block ("fd00::/112", prefix /108 or longer)
+ *   - "@path" to read one of the above per line from a file ('#' starts a comment)
+ *
+ * CIDR members are generated numerically without DNS; names are resolved once
+ * through default_target_cache(). Unresolvable names are reported once and kept
+ * with addr.family == AF_UNSPEC so callers can still account for them.
+ *
+ * @param spec Target specification string.
+ * @param out Hosts appended in specification order.
+ * @return false if the specification is malformed (an error is printed).
+ */
+bool parse_targets(const std::string& spec, std::vector<HostEntry>& out);
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <time.h>
+
+/**
+ * @brief Returns the current CLOCK_MONOTONIC time in milliseconds.
+ */
+inline uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000u + static_cast<uint64_t>(ts.tv_nsec) / 1000000u;
+}
+
+/**
+ * @brief Hashed timer wheel for per-probe deadlines.
+ *
+ * Each entry is tagged with a slot id and a generation counter. Cancellation is
+ * lazy: when a probe finishes early its generation is bumped by the owner, and
+ * the stale entry is skipped by the owner's expiry callback. Scheduling and
+ * expiry are O(1) per timer regardless of how many probes are in flight.
+ */
+class TimerWheel {
+public:
+    /**
+     * @brief Creates a wheel.
+     * @param tick_ms Resolution of the wheel in milliseconds.
+     * @param num_slots Number of buckets; deadlines beyond one revolution wrap.
+     */
+    TimerWheel(uint32_t tick_ms, std::size_t num_slots)
+        : tick_ms_(tick_ms ? tick_ms : 1),
+          slots_(num_slots ? num_slots : 1),
+          current_tick_(monotonic_ms() / tick_ms_),
+          pending_(0) {}
+
+    /**
+     * @brief Schedules a timer.
+     * @param now_ms Current monotonic time.
+     * @param delay_ms Delay until expiry.
+     * @param id Owner-defined slot id.
+     * @param gen Owner-defined generation used for lazy cancellation.
+     */
+    void schedule(uint64_t now_ms, uint32_t delay_ms, uint32_t id, uint32_t gen) {
+        uint64_t expiry_tick = (now_ms + delay_ms + tick_ms_ - 1) / tick_ms_;
+        if (expiry_tick <= current_tick_) expiry_tick = current_tick_ + 1;
+        slots_[expiry_tick % slots_.size()].push_back(Entry{expiry_tick, id, gen});
+        ++pending_;
+    }
+
+    /**
+     * @brief Fires every timer whose deadline is at or before now_ms.
+     * @param now_ms Current monotonic time.
+     * @param on_expire Callable invoked as on_expire(id, gen) for each expired entry.
+     */
+    template <typename F>
+    void advance(uint64_t now_ms, F&& on_expire) {
+        uint64_t now_tick = now_ms / tick_ms_;
+        while (current_tick_ <= now_tick && pending_ > 0) {
+            std::vector<Entry>& bucket = slots_[current_tick_ % slots_.size()];
+            std::size_t keep = 0;
+            for (std::size_t i = 0; i < bucket.size(); ++i) {
+                if (bucket[i].expiry_tick <= current_tick_) {
+                    --pending_;
+                    on_expire(bucket[i].id, bucket[i].gen);
+                } else {
+                    bucket[keep++] = bucket[i];
+                }
+            }
+            bucket.resize(keep);
+            ++current_tick_;
+        }
+        if (current_tick_ <= now_tick) current_tick_ = now_tick + 1;
+    }
+
+    /**
+     * @brief Milliseconds until the next tick boundary, or -1 if no timers are pending.
+     * @param now_ms Current monotonic time.
+     */
+    int next_timeout_ms(uint64_t now_ms) const {
+        if (pending_ == 0) return -1;
+        uint64_t next = current_tick_ * tick_ms_;
+        return next > now_ms ? static_cast<int>(next - now_ms) : 0;
+    }
+
+    /** @brief Number of scheduled entries, including lazily cancelled ones. */
+    std::size_t pending() const { return pending_; }
+
+private:
+    struct Entry {
+        uint64_t expiry_tick;
+        uint32_t id;
+        uint32_t gen;
+    };
+
+    uint32_t tick_ms_;
+    std::vector<std::vector<Entry>> slots_;
+    uint64_t current_tick_;
+    std::size_t pending_;
+};